@@ -0,0 +1,34 @@
+#!/bin/bash
+# Frames per second as the batch size (--batch) varies, for each resolution.
+# The lower resolutions are obtained transcoding the default video with ffmpeg.
+
+VIDEO=./videos/video2FULLHD.mp4
+NW=20
+BATCHES="1 2 4 8 16 32"
+RESOLUTIONS="320x240 640x480 1280x720 1920x1080"
+
+make
+
+for res in $RESOLUTIONS; do
+    src=/tmp/vmd_bench_$res.mp4
+    if [ "$res" == "1920x1080" ]; then
+        src=$VIDEO
+    elif [ ! -f $src ]; then
+        ffmpeg -loglevel error -y -i $VIDEO -vf scale=${res/x/:} $src
+    fi
+    # the first frame is the background
+    frames=$(( $(ffprobe -v error -count_frames -select_streams v:0 \
+        -show_entries stream=nb_read_frames -of csv=p=0 $src) - 1 ))
+
+    echo "---Resolution $res ($frames frames)---"
+    echo "batch,threads fps,fastflow A fps,fastflow B fps"
+    for b in $BATCHES; do
+        line="$b"
+        for version in 1 2 3; do
+            us=$(./main $version $NW 17 0.50461 1 --batch=$b --source=$src)
+            line="$line,$(echo "scale=1; $frames*1000000/$us" | bc)"
+        done
+        echo $line
+    done
+    echo ""
+done
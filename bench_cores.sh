@@ -0,0 +1,22 @@
+#!/bin/bash
+# Speedup of the farm of maps (version 3) over the sequential version, without a thread
+# budget (4 gray + 8 blur threads per pipeline) and with --cores set to the machine's cores.
+
+VIDEO=./videos/video2FULLHD.mp4
+CORES=$(nproc)
+FARMS="1 2 4 8 10 20"
+
+make
+
+seq=$(./main 0 1 17 0.50461 1 --source=$VIDEO)
+echo "Sequential: $seq us, $CORES cores"
+echo "farm workers,oversubscription,speedup,oversubscription (--cores=$CORES),speedup (--cores=$CORES)"
+for f in $FARMS; do
+    line="$f"
+    for budget in "" "--cores=$CORES"; do
+        over=$(./main 3 $f 17 0.50461 0 --source=$VIDEO $budget | grep Oversubscription | cut -d' ' -f2)
+        us=$(./main 3 $f 17 0.50461 1 --source=$VIDEO $budget)
+        line="$line,$over,$(echo "scale=2; $seq/$us" | bc)"
+    done
+    echo $line
+done
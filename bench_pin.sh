@@ -0,0 +1,29 @@
+#!/bin/bash
+# Execution time (us) of every engine unpinned and pinned. In the pinned layout the loader
+# has core 0 and the collector core 1, the workers (and the map threads of version 3) get
+# the other cores except the SMT siblings of core 0, so they do not fight with the loader.
+
+VIDEO=./videos/video2FULLHD.mp4
+NW=8
+CORES=$(nproc)
+SIBLINGS=$(cat /sys/devices/system/cpu/cpu0/topology/thread_siblings_list 2>/dev/null)
+
+# Cores of the workers: 2 ... CORES-1 without the siblings of core 0
+WORKERS=""
+for c in $(seq 2 $((CORES-1))); do
+    if ! echo ",$SIBLINGS," | tr '-' ',' | grep -q ",$c,"; then WORKERS="$WORKERS,$c"; fi
+done
+WORKERS=${WORKERS#,}
+PIN="--pin-decoder=0 --pin-collector=1 --pin-workers=$WORKERS"
+
+make
+
+echo "Workers on $WORKERS (siblings of core 0: $SIBLINGS)"
+echo "version,unpinned us,pinned us"
+for version in 1 2 3 4; do
+    extra=""
+    if [ $version == 3 ]; then extra="--pin-map=$WORKERS"; fi
+    unpinned=$(./main $version $NW 17 0.50461 1 --source=$VIDEO)
+    pinned=$(./main $version $NW 17 0.50461 1 --source=$VIDEO $PIN $extra)
+    echo "$version,$unpinned,$pinned"
+done
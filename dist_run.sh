@@ -0,0 +1,28 @@
+#!/bin/bash
+# Distributed farm (dmain) on one host over TCP loopback: a loader group, G worker groups
+# of N workers and a collector group, each one a process started by FastFlow's dff_run.
+# Build with: cmake -DDISTRIBUTED=ON -DCEREAL_INCLUDE=~/cereal/include . && make dmain
+# and fastflow/ff/distributed/loader (make CEREAL_HOME=~/cereal/include)
+#
+# usage: ./dist_run.sh G N ksize k stat [options]   e.g. ./dist_run.sh 2 4 7 0.2 1
+
+G=${1:-2}
+N=${2:-4}
+shift 2
+DFF_RUN=${DFF_RUN:-./fastflow/ff/distributed/loader/dff_run}
+CONFIG=$(mktemp --suffix=.json)
+PORT=${PORT:-8000}
+
+{
+	echo '{ "groups": ['
+	echo "  { \"name\": \"Loader\", \"endpoint\": \"localhost:$PORT\" },"
+	for ((g=0; g<G; g++)); do
+		echo "  { \"name\": \"W$g\", \"endpoint\": \"localhost:$((PORT+g+1))\" },"
+	done
+	echo "  { \"name\": \"Collector\", \"endpoint\": \"localhost:$((PORT+G+1))\" }"
+	echo '] }'
+} > $CONFIG
+
+# only the collector prints the results
+$DFF_RUN -v Collector -f $CONFIG ./dmain $G $N "$@"
+rm -f $CONFIG
@@ -0,0 +1,64 @@
+#include <opencv2/opencv.hpp>
+
+// Useful libraries
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <condition_variable>
+#include <vector>
+#include <queue>
+#include <deque>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <functional>
+#include <algorithm>
+
+// Fastflow Libraries (dff.hpp first: it enables the distributed runtime in every node)
+#include <ff/dff.hpp>
+#include <ff/pipeline.hpp>
+#include <ff/all2all.hpp>
+
+// More readable code. The distributed headers bring in namespace ff, whose cout/endl clash
+// with std's: the sources below see std's through the using-declarations of namespace vmd
+using namespace std;
+using namespace cv;
+
+#define ushort unsigned short
+#define ulong unsigned long
+#define DEFAULT_IMG Scalar(128)
+#define VIDEOSOURCE "./videos/video2FULLHD.mp4"
+#define ERROR_MSG(cond,msg) if(cond) { std::cout << msg << std::endl; exit(-1);}
+
+namespace vmd {
+using std::cout;
+using std::endl;
+
+#include <Utimer.cpp>
+#include <Utils.cpp>
+#include <Affinity.cpp> // Cores of each role of the engines
+#include <Options.cpp>  // Optional settings (--name=value)
+#include <Results.cpp>  // Per-frame results, reordering and sinks
+#include <Videodetect.cpp>
+#include <Distributed.cpp> // Farm over FastFlow's distributed runtime
+}
+using namespace vmd;
+
+// Distributed version of the farm, built with -DDISTRIBUTED=ON. Every group is a process:
+// dff_run -f config.json ./dmain groups nw ksize k stat [options]
+int main(int argc,char* argv[]) {
+
+	ERROR_MSG(ff::DFF_Init(argc,argv) != 0,"Wrong argument: --DFF_Config=file --DFF_GName=group are needed (see dist_run.sh)")
+	ERROR_MSG(argc<6,"Wrong argument:\n\tNumber of worker groups (n>0)\n\tWorkers per group (n>0)\n\tKernel size(ksize>=3)\n\tPercentage(k>0 and k=<1)\n\tTime execution[ 0 = False| 1 = True]\n\tOptions: --source=path --frames=N --timeline=file --counts=file --columns=file --events=file\n")
+
+	int groups  = atoi(argv[1]); // Worker groups (processes)
+	int nw      = atoi(argv[2]); // Workers per group
+	int ksize   = atoi(argv[3]); // Kernel size
+	float k     = atof(argv[4]); // Percentage trigger
+	int stat    = atoi(argv[5]); // Print Statistic
+	Options opt = Options::parse(argc,argv,6); // Optional settings
+
+	fastflow_d s(opt.source,ksize,k,groups,nw,opt);
+	s.execute(stat);
+	return 0;
+}
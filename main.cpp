@@ -14,7 +14,31 @@
 #include <condition_variable>
 #include <vector>
 #include <queue>
+#include <deque>
 #include <atomic>
+#include <fstream>
+#include <sstream>
+#include <functional>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <memory>
+#include <algorithm>
+
+#ifdef HAVE_LIBAV
+// Packets and motion vectors of the compressed video (--prefilter)
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/motion_vector.h>
+}
+#endif
 
 // More readable code
 using namespace std;	
@@ -30,27 +54,80 @@ using namespace cv;
 #include <Utimer.cpp>
 // Define a Shared queue
 #include <Utils.cpp>
+#include <Affinity.cpp> // Cores of each role of the engines
+#include <Options.cpp> // Optional settings (--name=value)
+#include <Results.cpp> // Per-frame results, reordering and sinks
+#include <Counts.cpp>  // Threshold queries on the per-frame difference counts
+#include <Columns.cpp> // Reader of the columnar per-frame results
+#include <Numa.cpp>    // NUMA topology and thread placement
+#include <RawCache.cpp>  // Video decoded once into a memory-mapped raw frame file
+#include <Synthetic.cpp> // Synthetic frames generated in memory (synthetic:WxHxN[:motion])
+#include <Decoders.cpp> // Parallel decoding of video segments
+#include <Checkpoint.cpp> // Checkpoint and resume of long jobs
+#include <Prefilter.cpp>  // Static frames found in the compressed video
+#include <YuvFile.cpp>  // Memory-mapped Y4M/raw yuv input
+#include <RawStream.cpp> // Raw frames from pipes and FIFOs
+#include <ShmRing.cpp>   // Frames from a shared-memory ring of a capture process
+#include <Elastic.cpp> // Elastic number of active workers
 
 #include <Videodetect.cpp>
 #include <Sequential.cpp> // Sequential program
 #include <ThreadFarm.cpp> // Standard Thread program
 #include <Fastflow_a.cpp> // Fastflow implementation (Normal form)
 #include <Fastflow_b.cpp> // Fastflow implementation Map&ParallelFor
+#include <TileFarm.cpp>   // Work-stealing tiles (low latency)
+#include <ThreadPipeline.cpp> // Three-stage pipeline of threads with SPSC rings
+#include <MultiStream.cpp> // Many videos sharing one pool of workers
+#include <Sweep.cpp>   // Grid of kernel sizes and percentages in one pass
+#include <Autotune.cpp>   // Calibration of version and workers
+#include <Server.cpp>     // Resident server with a warm pool of workers
 
 // Oss. It's better read first the report.
 
 int main(int argc,char* argv[]) {
 
-	ERROR_MSG(argc<6,"Wrong argument:\n\tVersion[\n\t\t0 = Sequential\n\t\t1 = Threads\n\t\t2 = Fastflow farm of Sequential node\n\t\t3 = Farm of map (+parallel for)]\n\tNumber of workers (n>0)\n\tKernel size(ksize>=3)\n\tPercentage(k>0 and k=<1)\n\tTime execution[ 0 = False| 1 = True]\n")
+	if (argc > 1 && string(argv[1]) == "query") { // detections for many k from a --counts file
+		query(argc,argv);
+		return 0;
+	}
+	if (argc > 1 && string(argv[1]) == "columns") { // a --columns file as CSV
+		columns(argc,argv);
+		return 0;
+	}
+	if (argc > 1 && string(argv[1]) == "produce") { // stand-in producer of a --shm ring
+		produce(argc,argv);
+		return 0;
+	}
+	if (argc > 1 && string(argv[1]) == "serve") { // resident server: serve socket-path nw
+		ERROR_MSG(argc < 4,"Wrong argument: serve socket-path nw")
+		Server(argv[2],atoi(argv[3])).listen();
+	}
+	if (argc > 1 && string(argv[1]) == "submit") { // jobs "path ksize k engine" from stdin
+		submit(argc,argv);
+		return 0;
+	}
+
+	ERROR_MSG(argc<6,"Wrong argument:\n\tVersion[\n\t\t0 = Sequential\n\t\t1 = Threads\n\t\t2 = Fastflow farm of Sequential node\n\t\t3 = Farm of map (+parallel for)\n\t\t4 = Work-stealing tiles (low latency)\n\t\t5 = Pipeline of threads decode|gray|blur (workers = blur threads)\n\t\t6 = Many videos (--streams) sharing one pool of workers\n\t\t7 = Sweep of kernel sizes (--ksizes) and percentages (--ks) in one pass]\n\tNumber of workers (n>0)\n\tKernel size(ksize>=3)\n\tPercentage(k>0 and k=<1)\n\tTime execution[ 0 = False| 1 = True| 2 = Stages/latency (versions 0,4,5)]\n\tOptions:\n\t\t--numa  pin workers per NUMA node (versions 1,2,3)\n\t\t--decoders=N  decode N segments in parallel (versions 1,2,3,5)\n\t\t--batch=B  send B consecutive frames per task (versions 1,2,3,7)\n\t\t--source=path  video to analyze (.y4m/.yuv are memory-mapped by version 1, synthetic:WxHxN[:motion] generates N frames in memory with the fraction motion of pixels changing, default 0.1)\n\t\t--size=WxH  shape of frame of a raw .yuv (yuv420p) or of a stream\n\t\t--stream  read raw frames from the source (a pipe, a FIFO or - for stdin) until EOF (version 1)\n\t\t--pix-fmt=F  pixel format of the stream: bgr24, rgb24, gray, yuv420p (limited range), yuvj420p (full range)\n\t\t--shm  the source is a shared-memory ring (e.g. /cam0) of a capture process (version 1), test producer: produce /name path [slots [frames]]\n\t\t--streams=file  videos of version 6, one per line: path [ksize [k]]\n\t\t--ksizes=list --ks=list  kernel sizes and percentages of version 7 (e.g. 3,5,7 and 0.1,0.2)\n\t\t--tiles=T  tiles per frame (version 4)\n\t\t--ordered  give the results in frame order (versions 1,2,3)\n\t\t--window=W  frames of the reorder buffer (versions 1,2,3)\n\t\t--timeline=file  per-frame results as CSV (versions 1,2,3, implies --ordered)\n\t\t--counts=file  per-frame difference counts (versions 1,2,3, implies --ordered), then: query file k1,k2,... [from-to ...]\n\t\t--columns=file  per-frame results in a columnar binary file (versions 1,2,3, implies --ordered), then: columns file [from-to]\n\t\t--events=file  motion events as CSV, written when they close (versions 1,2,3, implies --ordered), --event-gap=G --event-min=M  merge gaps of G frames, drop events shorter than M\n\t\t--checkpoint=file  checkpoint the job every --checkpoint-every=N frames (default 1000) and resume it from the file if it exists (versions 0,1,2,3, implies --ordered)\n\t\t--prefilter[=bytes]  skip the frames whose packets are tiny (default twice the 10th percentile of the non-key packets, at most 1% of the median keyframe), --prefilter-mvs  also the frames with zero motion vectors (decodes the whole video once more before the run), --prefilter-check  analyze them anyway and report the precision (versions 0,1, libav build)\n\t\t--cache-raw[=dir]  decode the video once into a raw frame file in dir (default vmd-cache), the next runs map it and skip the decoder (a .vmdraw file is also a valid --source)\n\t\t--cores=C  fit farm and maps in C threads (version 3)\n\t\t--elastic[=ms]  park and wake workers at run time (versions 1,2,3)\n\t\t--trace=file  active workers over time as CSV (--elastic)\n\t\t--pin-decoder=list --pin-workers=list --pin-collector=list --pin-map=list  cores of each role (e.g. 0-3,8), the collector of versions 1,2,3, the map threads are the pools of version 3 and the gray threads of version 5\n\t\t--frames=N  analyze only the first N frames\n\t\t--gray=G --blur=C  threads of the maps (version 3, default 4 and 8), --gray threads of the gray stage (version 5)\n\t\t--wavefront[=R]  blur starts on bands of R rows as soon as they are gray (version 3)\n\t\t--autotune  choose version and workers (cached in --tune-cache=file, bursts of --tune-frames=N)\n\tOther commands:\n\t\tserve socket-path nw  resident server, jobs \"path ksize k engine\" (engine 0 or 1) on a Unix socket\n\t\tsubmit socket-path < jobs  send jobs to the server and print the replies\n")
 
 	int version = atoi(argv[1]); // Version
 	int nw      = atoi(argv[2]); // Number of workers
 	int ksize   = atoi(argv[3]); // Kernel size
 	float k     = atof(argv[4]); // Percentage trigger
 	int stat    = atoi(argv[5]); // Print Statistic
+	Options opt = Options::parse(argc,argv,6); // Optional settings
+
+	if (opt.cacheraw != "") opt.source = RawCache::prepare(opt.source,opt.cacheraw); // decoded only the first time
+
+	if (opt.autotune) { // version and workers of argv are replaced by the best configuration
+		Tuning t = Autotune(opt,ksize,k).best();
+		version = t.version;
+		nw = t.nw;
+		if (t.cores > 0) opt.cores = t.cores;
+	}
+	ERROR_MSG(opt.unsupported(version) != "",opt.unsupported(version) << " cannot be used with version " << version)
 
 	if ( version == 0 ) { // Sequential approach
-		Sequential s(VIDEOSOURCE,ksize,k);
+		Sequential s(opt.source,ksize,k,opt);
 		if(stat == 0) s.execute_to_result();
 		else if (stat == 1) s.execute_to_stat();
 		else if (stat == 2) s.execute_to_stat2();
@@ -58,21 +135,51 @@ int main(int argc,char* argv[]) {
 	}
 
 	if ( version == 1 ) { // Farm of thread, standard C++ thread implementation
-		ThreadFarm s(VIDEOSOURCE,ksize,k,nw);
+		ThreadFarm s(opt.source,ksize,k,nw,opt);
 		if(stat == 0) s.execute_to_result();
 		else if (stat == 1) s.execute_to_stat();
 		else exit(-1);	
 	}
 
 	if ( version == 2 ) { // Farm of sequential node (Normal form)
-		fastflow_a s(VIDEOSOURCE,ksize,k,nw);
+		fastflow_a s(opt.source,ksize,k,nw,opt);
 		if(stat == 0) s.execute_to_result();
 		else if (stat == 1) s.execute_to_stat();
 		else exit(-1);		
 	}
 
 	if ( version == 3 ) { // Farm of pipeline of map-node
-		fastflow_b s(VIDEOSOURCE,ksize,k,4,8,nw);
+		fastflow_b s(opt.source,ksize,k,opt.gray,opt.blur,nw,opt);
+		if(stat == 0) s.execute_to_result();
+		else if (stat == 1) s.execute_to_stat();
+		else exit(-1);
+	}
+
+	if ( version == 4 ) { // Work-stealing tiles, a frame is processed by all the workers
+		TileFarm s(opt.source,ksize,k,nw,opt);
+		if(stat == 0) s.execute_to_result();
+		else if (stat == 1) s.execute_to_stat();
+		else if (stat == 2) s.execute_to_stat2();
+		else exit(-1);
+	}
+
+	if ( version == 5 ) { // Pipeline decode|gray|blur, each stage with its own threads
+		ThreadPipeline s(opt.source,ksize,k,nw,opt);
+		if(stat == 0) s.execute_to_result();
+		else if (stat == 1) s.execute_to_stat();
+		else if (stat == 2) s.execute_to_stat2();
+		else exit(-1);
+	}
+
+	if ( version == 6 ) { // Many videos, deficit round-robin on one pool of workers
+		MultiStream s(opt.streams,ksize,k,nw,opt);
+		if(stat == 0) s.execute_to_result();
+		else if (stat == 1) s.execute_to_stat();
+		else exit(-1);
+	}
+
+	if ( version == 7 ) { // One pass for a grid of kernel sizes and percentages
+		Sweep s(opt.source,ksize,k,nw,opt);
 		if(stat == 0) s.execute_to_result();
 		else if (stat == 1) s.execute_to_stat();
 		else exit(-1);
@@ -0,0 +1,33 @@
+/**
+ * @brief Cores assigned to each role of the engines (--pin-decoder, --pin-workers,
+ * --pin-collector, --pin-map). The i-th thread of a role is pinned on the i-th core of
+ * its list (wrapping around), the threads of a role without list are not pinned.
+ */
+struct Affinity {
+    vector<int> decoder;   // Loader and segment decoders
+    vector<int> workers;   // Farm workers (stages of the pipelines in version 3)
+    vector<int> collector; // Collector
+    vector<int> map;       // Threads of the parallel-for pools (version 3)
+
+    /**
+     * @brief Parse a core list such as "0-3,8,10-11"
+     */
+    static vector<int> parse(const string spec) {
+        vector<int> cores;
+        stringstream ss(spec);
+        string item;
+        while(getline(ss,item,',')) {
+            size_t dash = item.find('-');
+            int first = stoi(item.substr(0,dash));
+            int last  = dash == string::npos ? first : stoi(item.substr(dash+1));
+            ERROR_MSG(first < 0 || last < first,"Wrong core list " << spec)
+            for(int c=first;c<=last;c++) cores.push_back(c);
+        }
+        return cores;
+    }
+
+    // Core of the i-th thread of a role, -1 if the role is not pinned
+    static int at(const vector<int>& cores,int i) { return cores.empty() ? -1 : cores[i%cores.size()]; }
+
+    bool empty() const { return decoder.empty() && workers.empty() && collector.empty() && map.empty(); }
+};
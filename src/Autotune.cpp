@@ -0,0 +1,188 @@
+/**
+ * @brief Configuration chosen by the autotuner
+ */
+struct Tuning {
+    int version; // Engine
+    int nw;      // Workers (farm workers in version 3)
+    int cores;   // Thread budget of version 3 (--cores, 0 = no budget)
+};
+
+/**
+ * @brief Autotuner (--autotune): runs short calibration bursts on the first frames of the
+ * video for every engine and worker count and keeps the fastest configuration. The winner
+ * is saved in a cache file keyed by resolution, kernel size, CPU model and options, so the
+ * next runs on the same kind of input start tuned at once.
+ *
+ * Every engine terminates the process at the end, so each burst runs in a child process
+ * (this executable with --frames) and its elapsed time is read from its output. The bursts
+ * get the options of the run (batch, decoders, pinning, sinks, ...), so they calibrate the
+ * configuration that will run, and the options are part of the cache key.
+ */
+class Autotune {
+    private:
+    Options opt;  // Settings of the run (source, bursts length, cache file)
+    int ksize;    // Kernel size
+    float k;      // Percentage
+    string key;   // Cache key: resolution, kernel size, CPU model and options
+    vector<string> forward; // Options of the run given to the bursts
+
+    // Model of the CPU as reported by /proc/cpuinfo
+    static string cpuModel() {
+        ifstream in("/proc/cpuinfo");
+        string line;
+        while(getline(in,line))
+            if (line.rfind("model name",0) == 0) return line.substr(line.find(':')+2);
+        return "unknown";
+    }
+
+    /**
+     * @brief Options of the run for the bursts: the ones of the autotuner, the frames, the
+     * source (given apart, already cached) and the checkpoint are left out, the output files
+     * of the sinks become /dev/null (the bursts still pay for them), --cores is given by burst()
+     */
+    static vector<string> forwarded(const vector<string>& args) {
+        vector<string> list;
+        for(auto& arg : args) {
+            string name = arg.substr(0,arg.find('='));
+            if (name == "--autotune" || name == "--tune-frames" || name == "--tune-cache" ||
+                name == "--frames" || name == "--source" || name == "--cache-raw" ||
+                name == "--checkpoint" || name == "--checkpoint-every" || name == "--cores") continue;
+            if (name == "--timeline" || name == "--counts" || name == "--columns" ||
+                name == "--events" || name == "--trace") list.push_back(name + "=/dev/null");
+            else list.push_back(arg);
+        }
+        return list;
+    }
+
+    // Last configuration saved for the key that can run with the options, false if there is none
+    // (--checkpoint is not in the key)
+    bool lookup(Tuning& t) {
+        ifstream in(opt.tunecache);
+        string line;
+        bool found = false;
+        while(getline(in,line)) {
+            stringstream ss(line);
+            string k,version,nw,cores;
+            if (!getline(ss,k,'\t') || k != key) continue;
+            getline(ss,version,'\t'); getline(ss,nw,'\t'); getline(ss,cores,'\t');
+            if (opt.unsupported(stoi(version)) != "") continue;
+            t = {stoi(version),stoi(nw),stoi(cores)};
+            found = true;
+        }
+        return found;
+    }
+
+    void save(const Tuning& t) {
+        ofstream out(opt.tunecache,ios::app);
+        ERROR_MSG(!out.is_open(),"Error opening " << opt.tunecache)
+        out << key << "\t" << t.version << "\t" << t.nw << "\t" << t.cores << endl;
+    }
+
+    // Elapsed time (us) of a burst with the configuration t, -1 if the run failed
+    long burst(const Tuning& t) {
+        vector<string> args = { "main",to_string(t.version),to_string(t.nw),to_string(ksize),
+                                to_string(k),"1","--source="+opt.source,
+                                "--frames="+to_string(opt.tuneframes) };
+        args.insert(args.end(),forward.begin(),forward.end());
+        if (t.cores > 0) args.push_back("--cores="+to_string(t.cores));
+
+        int fd[2];
+        ERROR_MSG(pipe(fd) != 0,"Cannot create pipe")
+        pid_t pid = fork();
+        ERROR_MSG(pid < 0,"Cannot fork")
+        if (pid == 0) {
+            dup2(fd[1],STDOUT_FILENO);
+            close(fd[0]);
+            close(fd[1]);
+            vector<char*> argv;
+            for(auto& a : args) argv.push_back(const_cast<char*>(a.c_str()));
+            argv.push_back(nullptr);
+            execv("/proc/self/exe",argv.data());
+            _exit(127);
+        }
+        close(fd[1]);
+        string output;
+        char buf[256];
+        ssize_t n;
+        while((n = read(fd[0],buf,sizeof(buf))) > 0) output.append(buf,n);
+        close(fd[0]);
+
+        int status;
+        waitpid(pid,&status,0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) return -1;
+        return strtol(output.c_str(),nullptr,10);
+    }
+
+    // Engines and worker counts to try, around the number of cores
+    vector<Tuning> candidates() {
+        int c = ff_numCores();
+        vector<int> nws;
+        for(int n : {c/4,c/2,c,2*c})
+            if (n > 0 && find(nws.begin(),nws.end(),n) == nws.end()) nws.push_back(n);
+
+        vector<Tuning> all;
+        for(int version : {1,2,4})
+            for(int n : nws) all.push_back({version,n,0});
+        // the farm of maps shares the cores between farm workers and map threads
+        vector<int> farms;
+        for(int f : {1,2,4,c/4})
+            if (f > 0 && f <= max(1,c/2) && find(farms.begin(),farms.end(),f) == farms.end())
+                farms.push_back(f);
+        // a --cores of the run is the budget of the farm of maps (only version 3 has one)
+        for(int f : farms) all.push_back({3,f,opt.cores > 0 ? opt.cores : c});
+        // the versions that cannot run with the options of the run are left out
+        all.erase(remove_if(all.begin(),all.end(),[&](const Tuning& t){ return opt.unsupported(t.version) != ""; }),all.end());
+        return all;
+    }
+
+    public:
+    /**
+     * @param opt Settings of the run (source, --tune-frames, --tune-cache)
+     * @param ksize Kernel size
+     * @param k Percentage
+     */
+    Autotune(const Options opt,const int ksize,const float k): opt(opt),ksize(ksize),k(k),
+        forward(forwarded(opt.args)) {
+        int width,height;
+        if (YuvFile::accepts(opt.source)) {
+            // OpenCV cannot open a raw .yuv, its shape is in --size (or in the Y4M header)
+            YuvFile yuv(opt.source,opt.width,opt.height);
+            width  = yuv.cols();
+            height = yuv.rows();
+        } else {
+            VideoCapture* source = open_video(opt.source);
+            ERROR_MSG(!source->isOpened(),"Error opening video")
+            width  = source->get(CAP_PROP_FRAME_WIDTH);
+            height = source->get(CAP_PROP_FRAME_HEIGHT);
+            delete source;
+        }
+        this->key = to_string(width) + "x" + to_string(height) + " " + to_string(ksize) + " " + cpuModel();
+        for(auto& a : forward) key += " " + a;
+        if (opt.cores > 0) key += " --cores=" + to_string(opt.cores);
+    }
+
+    /**
+     * @brief The best configuration: from the cache, or calibrated and saved. The report
+     * goes on stderr, stdout carries only the results of the run.
+     */
+    Tuning best() {
+        Tuning t;
+        if (lookup(t)) {
+            cerr << "Autotune (cached): version " << t.version << ", nw " << t.nw << endl;
+            return t;
+        }
+        long bestus = -1;
+        for(auto& c : candidates()) {
+            long us = burst(c);
+            cerr << "Autotune: version " << c.version << ", nw " << c.nw;
+            if (c.cores > 0) cerr << ", cores " << c.cores;
+            if (us > 0) cerr << ": " << us << " us" << endl;
+            else cerr << ": failed" << endl;
+            if (us > 0 && (bestus < 0 || us < bestus)) { bestus = us; t = c; }
+        }
+        ERROR_MSG(bestus < 0,"Autotune: no configuration completed (or none can run with the options)")
+        save(t);
+        cerr << "Autotune: version " << t.version << ", nw " << t.nw << " saved in " << opt.tunecache << endl;
+        return t;
+    }
+};
@@ -0,0 +1,131 @@
+/**
+ * @brief Header of a checkpoint file (--checkpoint), followed by the background of the job:
+ * width*height bytes, the blurred first frame row after row. The video is identified by its
+ * size and modification time, the job by kernel size and percentage.
+ */
+struct CheckpointHeader {
+    char magic[8];        // "VMDCKPT"
+    uint32_t version;     // 1
+    int32_t ksize;        // Kernel size
+    float k;              // Percentage
+    int32_t width,height; // Shape of frame
+    int64_t size,mtime;   // Size and modification time (s) of the video
+    int64_t watermark;    // Every frame up to this one (included) has been analyzed
+    uint64_t detected;    // Frames "detected" up to the watermark
+};
+
+/**
+ * @brief Checkpoint of a long job: the watermark (last frame of the contiguous prefix of
+ * analyzed frames), the partial counters and the background. It is rewritten every "every"
+ * frames (in a temporary file renamed over the old one, so a killed job leaves either the
+ * old or the new checkpoint). When the file exists the job resumes from it: the background
+ * is not computed again and the video is read from the frame after the watermark.
+ */
+class Checkpoint {
+    private:
+        string path;               // Checkpoint file
+        CheckpointHeader h;
+        vector<uchar> saved;       // Background read from the file (when resuming)
+        const Mat* background;     // Background written in the checkpoints
+        long every;                // Frames between two checkpoints
+        long since;                // Frames since the last checkpoint
+        bool resumed;              // The job continues from the file
+        long written,spent;        // Checkpoints written and their time (us)
+        vector<ResultSink*> sinks; // Synced before every checkpoint
+
+    public:
+        Checkpoint(const string path,const string video,int ksize,float k,int width,int height,long every):
+            path(path),background(nullptr),every(every),since(0),resumed(false),written(0),spent(0) {
+
+            // a synthetic video is identified by its path (shape and frames)
+            struct stat st = {};
+            ERROR_MSG(!SyntheticVideo::accepts(video) && stat(video.c_str(),&st) != 0,"Error opening " << video)
+            h = {{'V','M','D','C','K','P','T',0},1,ksize,k,width,height,st.st_size,st.st_mtime,0,0};
+
+            ifstream in(path,ios::binary);
+            if (!in.is_open()) return; // a new job
+            CheckpointHeader old;
+            in.read((char*)&old,sizeof(old));
+            ERROR_MSG(!in || memcmp(old.magic,h.magic,8) != 0 || old.version != 1,"Wrong checkpoint " << path)
+            ERROR_MSG(old.ksize != ksize || old.k != k || old.width != width || old.height != height ||
+                      old.size != h.size || old.mtime != h.mtime,
+                      "The checkpoint " << path << " belongs to another job (remove it to start again)")
+            saved.resize((size_t)width*height);
+            in.read((char*)saved.data(),saved.size());
+            ERROR_MSG(!in,"Wrong checkpoint " << path)
+            h.watermark = old.watermark;
+            h.detected = old.detected;
+            resumed = true;
+        }
+
+        // The checkpoint of the options, nullptr without --checkpoint
+        static Checkpoint* open(const Options& opt,const string video,int ksize,float k,int width,int height) {
+            if (opt.checkpoint == "") return nullptr;
+            return new Checkpoint(opt.checkpoint,video,ksize,k,width,height,opt.checkpointevery);
+        }
+
+        bool resuming() const { return resumed; }
+        long watermark() const { return h.watermark; }  // Last frame analyzed
+        long first() const { return h.watermark+1; }   // First frame to analyze
+        ulong detected() const { return h.detected; }
+        long count() const { return written; }
+        long time() const { return spent; }
+
+        /**
+         * @brief Background of the checkpoint (the caller owns it), the source (if any) is
+         * positioned on the first frame to analyze
+         */
+        Mat* restore(VideoCapture* source) {
+            Mat* bg = new Mat(h.height,h.width,CV_8UC1,DEFAULT_IMG);
+            for (int i = 0; i < h.height; i++)
+                memcpy(bg->ptr<uchar>(i),saved.data()+(size_t)i*h.width,h.width);
+            if (source) seek_to(source,first());
+            return bg;
+        }
+
+        // Background written in the checkpoints, it lives as long as the job
+        void keep(const Mat* bg) { background = bg; }
+
+        // Sinks whose files must hold the frames up to the watermark of each checkpoint
+        void follow(const vector<ResultSink*>& s) { sinks = s; }
+
+        // The next frame in order has been analyzed
+        void advance(const Result& r) {
+            h.watermark = r.idx;
+            h.detected += r.detected;
+            if (++since >= every) save();
+        }
+
+        void save() {
+            auto start = chrono::steady_clock::now();
+            for(auto s : sinks) s->sync();
+            string tmp = path + ".tmp";
+            {
+                ofstream out(tmp,ios::binary);
+                ERROR_MSG(!out.is_open(),"Error opening " << tmp)
+                out.write((const char*)&h,sizeof(h));
+                for (int i = 0; i < h.height; i++) out.write((const char*)background->ptr<uchar>(i),h.width);
+                ERROR_MSG(!out,"Error writing " << tmp)
+            }
+            ERROR_MSG(std::rename(tmp.c_str(),path.c_str()) != 0,"Error writing " << path)
+            since = 0;
+            written++;
+            spent += chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+        }
+};
+
+/**
+ * @brief Moves the watermark of the checkpoint with the results in frame order, the last
+ * checkpoint is written after the last frame. It follows the other sinks (they get each
+ * result first), so their files are synced with every checkpoint.
+ */
+class CheckpointSink : public ResultSink {
+    private:
+        Checkpoint* checkpoint;
+    public:
+        CheckpointSink(Checkpoint* checkpoint,const vector<ResultSink*>& sinks): checkpoint(checkpoint) {
+            checkpoint->follow(sinks);
+        }
+        void put(const Result& r) { checkpoint->advance(r); }
+        void end() { checkpoint->save(); }
+};
@@ -0,0 +1,90 @@
+/**
+ * @brief Columnar file of the per-frame results written by --columns, mapped in memory.
+ * The columns of each chunk are contiguous arrays read in place: scanning a column touches
+ * only its bytes and nothing is parsed.
+ */
+class Columns {
+    public:
+        // The columns of a chunk of rows
+        struct Chunk {
+            uint32_t rows;
+            const int64_t* idx;     // Index of the frame
+            const int64_t* time;    // Time (us since the start) the result reached the collector
+            const uint32_t* totald; // Pixels that are different from the background
+            const uint32_t* gray;   // Time (us) of the gray stage
+            const uint32_t* blur;   // Time (us) of the blur stage
+            const uint8_t* detected;// 1 if the frame is "different" from background
+        };
+
+    private:
+        int fd;              // File descriptor of the results
+        void* map;           // Mapping of the whole file
+        size_t length;       // Bytes of the file
+        vector<Chunk> all;   // Chunks of the file
+        long nrows;          // Rows of all the chunks
+
+    public:
+        Columns(const string path): nrows(0) {
+            fd = open(path.c_str(),O_RDONLY);
+            ERROR_MSG(fd < 0,"Error opening " << path)
+            struct stat st;
+            ERROR_MSG(fstat(fd,&st) != 0,"Error opening " << path)
+            length = st.st_size;
+            ERROR_MSG(length < sizeof(ColumnsHeader),"Wrong results file " << path)
+            map = mmap(nullptr,length,PROT_READ,MAP_SHARED,fd,0);
+            ERROR_MSG(map == MAP_FAILED,"Error mapping " << path)
+
+            const char* base = (const char*)map;
+            ERROR_MSG(memcmp(base,"VMDR",4) != 0 || ((const ColumnsHeader*)base)->version != 1,
+                      "Wrong results file " << path)
+            size_t pos = sizeof(ColumnsHeader);
+            while(pos + sizeof(ColumnsChunk) <= length) {
+                const ColumnsChunk* c = (const ColumnsChunk*)(base+pos);
+                const char* p = base + pos + sizeof(ColumnsChunk);
+                if (pos + sizeof(ColumnsChunk) + c->bytes > length) break; // truncated
+                size_t n = c->rows;
+                Chunk k;
+                k.rows = n;
+                k.idx = (const int64_t*)p;       p += 8*n;
+                k.time = (const int64_t*)p;      p += 8*n;
+                k.totald = (const uint32_t*)p;   p += 4*n;
+                k.gray = (const uint32_t*)p;     p += 4*n;
+                k.blur = (const uint32_t*)p;     p += 4*n;
+                k.detected = (const uint8_t*)p;
+                all.push_back(k);
+                nrows += n;
+                pos += sizeof(ColumnsChunk) + c->bytes;
+            }
+        }
+
+        ~Columns() {
+            munmap(map,length);
+            close(fd);
+        }
+
+        long rows() const { return nrows; }
+        const vector<Chunk>& chunks() const { return all; }
+};
+
+/**
+ * @brief Print the results of a columnar file as CSV: "main columns file [from-to]" (the
+ * frames from..to included, all if no range is given)
+ */
+void columns(int argc,char* argv[]) {
+    ERROR_MSG(argc < 3,"Wrong argument: columns results-file [from-to]")
+    Columns file(argv[2]);
+    long from = LONG_MIN,to = LONG_MAX;
+    if (argc > 3) {
+        string r(argv[3]);
+        size_t dash = r.find('-');
+        ERROR_MSG(dash == string::npos,"Wrong range " << r << " (from-to)")
+        from = stol(r.substr(0,dash));
+        to = stol(r.substr(dash+1));
+    }
+    cout << "frame,time,totald,detected,gray,blur\n";
+    for(auto& c : file.chunks())
+        for(uint32_t i=0;i<c.rows;i++)
+            if (c.idx[i] >= from && c.idx[i] <= to)
+                cout << c.idx[i] << "," << c.time[i] << "," << c.totald[i] << "," << (int)c.detected[i]
+                     << "," << c.gray[i] << "," << c.blur[i] << "\n";
+}
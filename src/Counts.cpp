@@ -0,0 +1,110 @@
+/**
+ * @brief File of the per-frame difference counts written by --counts, mapped in memory.
+ * A frame is "detected" for a percentage k if totald/pixels > k, so the detections of any
+ * k over any range of frames are computed without analyzing the video again.
+ *
+ * The counts are also stored sorted inside blocks of about sqrt(frames) frames: a query
+ * scans the frames of the (at most two) partial blocks and makes a binary search in each
+ * full block.
+ */
+class Counts {
+    private:
+        int fd;                     // File descriptor of the counts
+        void* map;                  // Mapping of the whole file
+        size_t length;              // Bytes of the file
+        const CountsHeader* header;
+        const uint32_t* totald;     // Counts in frame order
+        const uint32_t* sorted;     // Counts sorted inside each block
+
+        // Same comparison of the engines, a frame not analyzed is not detected
+        bool detected(uint32_t t,float k) const { return t != COUNT_SKIPPED && (((float)t)/header->pixels) > k; }
+
+        // Frames of the sorted block b detected for k (the frames not analyzed are at its end)
+        long countBlock(long b,float k) const {
+            const uint32_t* begin = sorted + b*header->block;
+            const uint32_t* end = sorted + min((long)header->frames,(b+1)*(long)header->block);
+            end = lower_bound(begin,end,COUNT_SKIPPED);
+            return end - partition_point(begin,end,[&](uint32_t t){ return !detected(t,k); });
+        }
+
+    public:
+        Counts(const string path) {
+            fd = open(path.c_str(),O_RDONLY);
+            ERROR_MSG(fd < 0,"Error opening " << path)
+            struct stat st;
+            ERROR_MSG(fstat(fd,&st) != 0,"Error opening " << path)
+            length = st.st_size;
+            ERROR_MSG(length < sizeof(CountsHeader),"Wrong counts file " << path)
+            map = mmap(nullptr,length,PROT_READ,MAP_SHARED,fd,0);
+            ERROR_MSG(map == MAP_FAILED,"Error mapping " << path)
+
+            header = (const CountsHeader*)map;
+            ERROR_MSG(memcmp(header->magic,"VMDC",4) != 0 || header->block == 0 ||
+                      length < sizeof(CountsHeader) + 2*header->frames*sizeof(uint32_t),
+                      "Wrong counts file " << path)
+            totald = (const uint32_t*)(header+1);
+            sorted = totald + header->frames;
+        }
+
+        ~Counts() {
+            munmap(map,length);
+            close(fd);
+        }
+
+        long first() const { return header->first; }
+        long last() const { return header->first + header->frames - 1; }
+        long pixels() const { return header->pixels; }
+
+        /**
+         * @brief Frames detected for the percentage k among the frames from..to (included)
+         */
+        long motion(float k,long from,long to) const {
+            long a = max(from,first()) - first(),b = min(to,last()) - first() + 1; // [a,b)
+            long block = header->block,n = 0;
+            while(a < b && a % block != 0) n += detected(totald[a++],k);
+            while(a < b) {
+                long end = min(a+block,(long)header->frames);
+                if (end > b) break;
+                n += countBlock(a/block,k);
+                a = end;
+            }
+            while(a < b) n += detected(totald[a++],k);
+            return n;
+        }
+};
+
+/**
+ * @brief Query of a counts file: "main query file k1,k2,... [from-to ...]" prints the frames
+ * detected for each k in each range of frames (the whole file if no range is given)
+ */
+void query(int argc,char* argv[]) {
+    ERROR_MSG(argc < 4,"Wrong argument: query counts-file k1,k2,... [from-to ...]")
+    Counts counts(argv[2]);
+
+    vector<float> ks;
+    stringstream list(argv[3]);
+    string k;
+    while(getline(list,k,',')) {
+        ks.push_back(stof(k));
+        ERROR_MSG(ks.back() <= 0 || ks.back() > 1,"%'of pixel must be between 0 and 1")
+    }
+
+    vector<pair<long,long>> ranges;
+    for(int i=4;i<argc;i++) {
+        string r(argv[i]);
+        size_t dash = r.find('-');
+        ERROR_MSG(dash == string::npos,"Wrong range " << r << " (from-to)")
+        ranges.push_back({stol(r.substr(0,dash)),stol(r.substr(dash+1))});
+    }
+    if (ranges.empty()) ranges.push_back({counts.first(),counts.last()});
+
+    long elapsed;
+    {
+        utimer u("",&elapsed);
+        for(auto& r : ranges)
+            for(auto k : ks)
+                cout << "k " << k << ", frames " << r.first << "-" << r.second << ": "
+                     << counts.motion(k,r.first,r.second) << endl;
+    }
+    cerr << "Query: " << elapsed << " us" << endl;
+}
@@ -0,0 +1,110 @@
+/**
+ * @brief Split the frames to analyze (1 ... totalf-1, the frame 0 is the background) into
+ * n contiguous segments of the same length.
+ *
+ * @param totalf Number of total frame in the video
+ * @param n Number of segments
+ * @return vector<long> n+1 boundaries, segment i is [bounds[i],bounds[i+1])
+ */
+vector<long> segments(long totalf,int n) {
+    vector<long> bounds(n+1);
+    long frames = totalf-1;
+    for(int i=0;i<=n;i++) bounds[i] = 1 + frames*i/n;
+    return bounds;
+}
+
+/**
+ * @brief Position the video on the frame "from". The backend may stop on the keyframe before
+ * "from", in this case the frames up to "from" are skipped so the indices stay correct.
+ */
+void seek_to(VideoCapture* source,long from) {
+    if (from > 0) source->set(CAP_PROP_POS_FRAMES,from);
+    long pos = source->get(CAP_PROP_POS_FRAMES);
+    ERROR_MSG(pos > from,"Error in seek operation")
+    for(;pos<from;pos++) ERROR_MSG(!source->grab(),"Error in read frame operation")
+}
+
+/**
+ * @brief Open the video positioned on the frame "from" (see seek_to)
+ *
+ * @param path Path of the video
+ * @param from First frame to read
+ * @return VideoCapture* the opened video
+ */
+VideoCapture* open_at(const string path,long from) {
+    VideoCapture* source = open_video(path);
+    ERROR_MSG(!source->isOpened(),"Error opening video")
+    seek_to(source,from);
+    return source;
+}
+
+/**
+ * @brief Decoder of a contiguous segment [from,to) of the video. Each decoder has its own
+ * VideoCapture seeked with CAP_PROP_POS_FRAMES, so more decoders work on the same file in
+ * parallel. The last decoder that finishes closes all the queues.
+ *
+ * @param path Path of the video
+ * @param from First frame of the segment
+ * @param to First frame after the segment
+ * @param queue Queue where the frames are pushed
+ * @param all All the queues fed by the decoders (closed at the end)
+ * @param running Number of decoders still running
+ * @param cpu cpu where the decoder is pinned (-1 no pinning)
+ * @param B number of frames per batch
+ */
+void segment_decoder(const string path,long from,long to,SQueue* queue,vector<SQueue*>* all,
+                     atomic<int>* running,int cpu,int B) {
+
+    if (cpu >= 0) NumaTopology::pin(pthread_self(),cpu);
+
+    VideoCapture* source = open_at(path,from);
+
+    int width  = source->get(CAP_PROP_FRAME_WIDTH);
+    int height = source->get(CAP_PROP_FRAME_HEIGHT);
+    int nbytes = sizeof(unsigned char)*width*height*3;
+
+    Mat frame,*original;
+    BatchBuilder batches(B);
+    for(long f=from;f<to;f++) {
+
+        ERROR_MSG(!source->read(frame),"Error in read frame operation")
+        original = new Mat(height,width,CV_8UC3,Scalar(0,0,0));
+        memcpy(original->data, frame.data, nbytes);
+        Batch* batch = batches.add(new Frame(original,f));
+        if (batch) queue->push(batch);
+    }
+    Batch* last = batches.flush();
+    if (last) queue->push(last);
+    source->release();
+    delete source;
+
+    if (--(*running) == 0)
+        for(auto q : *all) q->end();
+}
+
+/**
+ * @brief Start n segment decoders that feed the queues. With one queue per NUMA node the
+ * decoder d is pinned on a node with workers (topo->decoderNode) and pushes into that
+ * node's queue.
+ *
+ * @param path Path of the video
+ * @param totalf Number of total frame in the video
+ * @param n Number of decoders
+ * @param B Number of frames per batch
+ * @param queues Queues to feed (one, or one per NUMA node)
+ * @param running Counter of the running decoders (set to n)
+ * @param topo NUMA topology (nullptr = no pinning)
+ * @return vector<thread*> decoding threads
+ */
+vector<thread*> start_decoders(const string path,long totalf,int n,int B,vector<SQueue*>* queues,
+                               atomic<int>* running,NumaTopology* topo) {
+    vector<long> bounds = segments(totalf,n);
+    vector<thread*> decoders(n);
+    *running = n;
+    for(int d=0;d<n;d++) {
+        SQueue* q = (*queues)[topo ? topo->decoderNode(d) : 0];
+        decoders[d] = new thread(segment_decoder,path,bounds[d],bounds[d+1],q,queues,running,
+                                 topo ? topo->decoderCpu(d) : -1,B);
+    }
+    return decoders;
+}
@@ -0,0 +1,249 @@
+/**
+ * @brief Decoded frame shipped from the loader group to the worker groups (BGR, width*height*3
+ * bytes, no padding). The gray conversion is left to the workers: the loader is a single
+ * process and only decodes.
+ */
+struct BgrFrame {
+    long idx;             // Index of the frame in the video
+    int width,height;     // Shape of frame
+    vector<uchar> pixels; // BGR pixels, row after row
+};
+
+// ---- Serialization of the messages between groups (FastFlow's user-defined functions) ----
+// serialize gives the ownership of the buffer to the runtime and frees the message,
+// deserialize receives the ownership of the buffer. The runtime finds its wrappers of these
+// functions by argument-dependent lookup, in the namespace of the messages.
+using ff::serializeWrapper;
+using ff::deserializeWrapper;
+
+template<typename Buffer>
+void serialize(Buffer& b,BgrFrame* f) {
+    size_t n = sizeof(int64_t) + 2*sizeof(int32_t) + f->pixels.size();
+    char* p = new char[n];
+    b.first = p;
+    b.second = n;
+    int64_t idx = f->idx;
+    int32_t shape[2] = {f->width,f->height};
+    memcpy(p,&idx,sizeof(idx));                 p += sizeof(idx);
+    memcpy(p,shape,sizeof(shape));              p += sizeof(shape);
+    memcpy(p,f->pixels.data(),f->pixels.size());
+    delete f;
+}
+
+template<typename Buffer>
+void deserialize(const Buffer& b,BgrFrame*& f) {
+    const char *p = b.first,*end = b.first+b.second;
+    int64_t idx;
+    int32_t shape[2];
+    memcpy(&idx,p,sizeof(idx));                 p += sizeof(idx);
+    memcpy(shape,p,sizeof(shape));              p += sizeof(shape);
+    f = new BgrFrame{idx,shape[0],shape[1],vector<uchar>(p,end)};
+    delete[] b.first;
+}
+
+template<typename Buffer>
+void serialize(Buffer& b,Result* r) {
+    b.first = new char[sizeof(Result)];
+    b.second = sizeof(Result);
+    memcpy(b.first,r,sizeof(Result));
+    delete r;
+}
+
+template<typename Buffer>
+void deserialize(const Buffer& b,Result*& r) {
+    r = new Result();
+    memcpy(r,b.first,sizeof(Result));
+    delete[] b.first;
+}
+
+// The loader group: decodes the video and ships the frames
+class dff_loader : public ff::ff_monode_t<BgrFrame> {
+    private:
+    string path;      // Path of the video
+    long totalf;      // Frames to read (background included)
+
+    public:
+    dff_loader(const string path,long totalf): path(path),totalf(totalf) { }
+
+    BgrFrame* svc(BgrFrame*) {
+        VideoCapture source(path);
+        ERROR_MSG(!source.isOpened(),"Error opening video")
+        int width  = source.get(CAP_PROP_FRAME_WIDTH);
+        int height = source.get(CAP_PROP_FRAME_HEIGHT);
+        Mat frame;
+        source.read(frame); // the background, every worker group computes its own
+
+        for(long f=1;f<totalf;f++) {
+            ERROR_MSG(!source.read(frame),"Error in read frame operation")
+            ff_send_out(new BgrFrame{f,width,height,vector<uchar>(frame.data,frame.data+(size_t)width*height*3)});
+        }
+        return EOS;
+    }
+};
+
+// A worker of a worker group: converts the frame to gray, blurs it and compares it with the background
+class dff_worker : public ff::ff_node_t<BgrFrame,Result> {
+    private:
+    string path;          // Path of the video (the groups share the filesystem)
+    int dx,dim;           // "padding" and kernel's dimentions
+    float k;              // Percentage
+    Mat *background,*gray;
+
+    public:
+    dff_worker(const string path,int ksize,float k):
+        path(path),dx(ksize/2),dim(ksize*ksize),k(k),background(nullptr),gray(nullptr) { }
+
+    // The background is computed in the worker's process, it does not travel on the network
+    int svc_init() {
+        VideoCapture source(path);
+        ERROR_MSG(!source.isOpened(),"Error opening video")
+        int width  = source.get(CAP_PROP_FRAME_WIDTH);
+        int height = source.get(CAP_PROP_FRAME_HEIGHT);
+        Mat frame;
+        ERROR_MSG(!source.read(frame),"Error in read frame operation")
+        Mat* first = VideoDetect::static_toGray(frame,height,width,dx);
+        background = VideoDetect::static_convolve(first,height,width,dx);
+        delete first;
+        gray = new Mat(height+dx+dx,width+dx+dx,CV_8UC1,DEFAULT_IMG);
+        return 0;
+    }
+
+    void svc_end() {
+        delete background;
+        delete gray;
+    }
+
+    Result* svc(BgrFrame* frame) {
+        int width = frame->width,height = frame->height;
+        const uchar* p = frame->pixels.data();
+        float r,g,b;
+        for (int i = 0; i < height; i++) {
+            for (int j = 0; j < width; j++,p+=3){
+                r = 0.2989  * p[2];
+                g = 0.5870  * p[1];
+                b = 0.1140  * p[0];
+                gray->at<uchar>(i+dx, j+dx) = round(r+g+b);
+            }
+        }
+
+        ulong totald = 0;
+        float acc;
+        for (int i = 0; i < height ; i++) {
+            for (int j = 0; j < width ; j++) {
+                acc = 0;
+                for(int z=-dx;z<=dx;z++)for(int w=-dx;w<=dx;w++)
+                        acc += gray->at<uchar>(i+dx+z,j+dx+w);
+                totald += background->at<uchar>(i, j) - static_cast<uchar>(acc/dim) != 0;
+            }
+        }
+        Result* res = new Result{frame->idx,totald,(((float)totald)/((long)width*height)) > k};
+        delete frame;
+        return res;
+    }
+};
+
+// The collector group: counts the detections and gives the results in order to the sinks
+class dff_collector : public ff::ff_minode_t<Result> {
+    private:
+    ulong totalDiff = 0;       // Frames "detected"
+    long frames = 0;           // Results received
+    vector<ResultSink*> sinks; // Consumers of the results (in frame order)
+    long next = 1;             // Next frame to give to the sinks
+    priority_queue<Result,vector<Result>,ResultAfter> pending;
+
+    public:
+    dff_collector(vector<ResultSink*> sinks): sinks(sinks) { }
+    ~dff_collector() { for(auto s : sinks) delete s; }
+
+    Result* svc(Result* r) {
+        totalDiff += r->detected;
+        frames++;
+        if (!sinks.empty()) pending.push(*r);
+        delete r;
+        while(!pending.empty() && pending.top().idx == next) {
+            for(auto s : sinks) s->put(pending.top());
+            pending.pop();
+            next++;
+        }
+        return GO_ON;
+    }
+    void svc_end() { for(auto s : sinks) s->end(); }
+
+    ulong detected() const { return totalDiff; }
+    long received() const { return frames; }
+};
+
+/**
+ * @brief Distributed version of fastflow_a on FastFlow's distributed runtime: a loader group
+ * ships the decoded frames to "groups" worker groups of nw workers each, the results come back to a
+ * collector group. Every process runs the same program with --DFF_Config and --DFF_GName
+ * (dff_run starts them), the groups are "Loader", "W0" ... "Wn-1" and "Collector".
+ */
+class fastflow_d {
+    private:
+    string path;     // Path of the video
+    int ksize;       // Kernel size
+    float k;         // Percentage
+    int groups,nw;   // Worker groups and workers per group
+    long totalf;     // Number of total frame in the video
+    Options opt;     // Optional settings
+
+    public:
+    fastflow_d(const string path,const int ksize,const float k,const int groups,const int nw,
+               const Options opt = Options()):
+        path(path),ksize(ksize),k(k),groups(groups),nw(nw),opt(opt) {
+
+        ERROR_MSG(path == "","path error")
+        ERROR_MSG(ksize < 3 || ksize%2==0,"kernel size must be >3 and odd")
+        ERROR_MSG(k<= 0 || k>1,"%'of pixel must be between 0 and 1")
+        ERROR_MSG(groups <= 0 || nw <= 0,"Groups and workers must be more than 0")
+
+        VideoCapture source(path);
+        ERROR_MSG(!source.isOpened(),"Error opening video")
+        this->totalf = frame_count(source,opt);
+        ERROR_MSG(totalf<3,"Too short video")
+    }
+
+    // Run the group of this process, the collector group prints the results
+    void execute(int stat) {
+        int width,height;
+        {
+            VideoCapture source(path);
+            width  = source.get(CAP_PROP_FRAME_WIDTH);
+            height = source.get(CAP_PROP_FRAME_HEIGHT);
+        }
+        dff_loader loader(path,totalf);
+        vector<dff_worker*> workers;
+        for(int i=0;i<groups*nw;i++) workers.push_back(new dff_worker(path,ksize,k));
+        bool collects = ff::DFF_getMyGroup() == "Collector";
+        dff_collector collector(collects ? make_sinks(opt,(long)width*height) : vector<ResultSink*>());
+
+        ff::ff_a2a a2a;
+        a2a.add_firstset<dff_loader>({&loader});
+        a2a.add_secondset<dff_worker>(workers);
+        ff::ff_pipeline pipe;
+        pipe.add_stage(&a2a);
+        pipe.add_stage(&collector);
+
+        a2a.createGroup("Loader") << &loader;
+        for(int g=0;g<groups;g++) {
+            auto group = a2a.createGroup("W" + to_string(g));
+            for(int i=0;i<nw;i++) group << workers[g*nw+i];
+        }
+        collector.createGroup("Collector");
+
+        long elapsed;
+        {
+            utimer u("",&elapsed);
+            ERROR_MSG(pipe.run_and_wait_end() < 0,"Error running the group " << ff::DFF_getMyGroup())
+        }
+        if (collects) {
+            if (stat == 0) {
+                cout << "Total frame: " << collector.received()+1 << endl;
+                cout << "Total diff: " << collector.detected() << endl;
+            } else cout << elapsed << endl;
+        }
+        for(auto w : workers) delete w;
+        exit(0);
+    }
+};
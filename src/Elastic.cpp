@@ -0,0 +1,124 @@
+/**
+ * @brief State of the elastic controller at the end of a period
+ */
+struct ElasticSample {
+    long ms;       // Time from the start (ms)
+    int active;    // Active workers
+    long inflight; // Tasks given to the workers and not yet completed
+    long service;  // Mean service time of a task in the period (us)
+};
+
+/**
+ * @brief Controller of the elastic mode (--elastic): every period it looks at the tasks
+ * waiting for a worker and at the service time of the workers, and decides how many
+ * workers stay active. The others are parked: they get no task until they are woken up.
+ *
+ * The workers needed are arrivals*service (the load of the period) kept under 85% of
+ * utilization, plus one when the backlog grows beyond two tasks per active worker.
+ * The controller wakes workers at once but parks one worker per period. It never goes
+ * below minw active workers: with --numa the workers are placed round-robin over the nodes,
+ * so keeping the first "nodes" ids active leaves a worker serving every node.
+ */
+class Elastic {
+    private:
+        int maxw;                 // Workers of the farm
+        int minw;                 // Workers never parked (ids 0 ... minw-1)
+        int period;               // Time between two decisions (ms)
+        atomic<int> nactive;      // Workers that can take a task (ids 0 ... nactive-1)
+        atomic<long> nsent,ndone; // Tasks given to the workers / completed
+        atomic<long> busy;        // Service time of the completed tasks (us)
+        atomic<bool> stopped;
+        function<long()> probe;   // Counts the tasks sent, when the engine does not call sent()
+        vector<ElasticSample> samples;
+        thread* monitor;
+        mutex mtx;                // Parking lot of the std::thread workers
+        condition_variable wake;
+
+        void decide() {
+            auto start = chrono::steady_clock::now();
+            long sent0 = 0,done0 = 0,busy0 = 0;
+
+            while(!stopped) {
+                this_thread::sleep_for(chrono::milliseconds(period));
+                long sent = probe ? probe() : nsent.load(),done = ndone,us = busy;
+                long ms = chrono::duration_cast<chrono::milliseconds>(
+                            chrono::steady_clock::now() - start).count();
+
+                int active = nactive;
+                long inflight = sent-done;
+                long service = done > done0 ? (us-busy0)/(done-done0) : 0;
+
+                if (service > 0) {
+                    // arrivals per us * service time = busy workers
+                    float load = (float)(sent-sent0)/(period*1000) * service;
+                    int need = ceil(load/0.85);
+                    if (inflight > 2*active) need = max(need,active+1);
+                    if (need < active) need = active-1;
+                    setActive(min(max(need,minw),maxw));
+                }
+                samples.push_back({ms,(int)nactive,inflight,service});
+                sent0 = sent; done0 = done; busy0 = us;
+            }
+        }
+
+        void setActive(int n) {
+            {
+                lock_guard<mutex> l(mtx);
+                nactive = n;
+            }
+            wake.notify_all();
+        }
+
+    public:
+        Elastic(int maxw,int period,int minw = 1): maxw(maxw),minw(min(max(minw,1),maxw)),period(period),
+            nactive(maxw),nsent(0),ndone(0),busy(0),stopped(false),monitor(nullptr) { }
+
+        ~Elastic() { delete monitor; }
+
+        void start() { monitor = new thread(&Elastic::decide,this); }
+
+        // Read the number of tasks sent from the engine (e.g. the pushes into its queues)
+        void watch(function<long()> sent) { probe = sent; }
+
+        // Stop deciding and wake all the parked workers (they must see the end of stream)
+        void stop() {
+            stopped = true;
+            if (monitor) monitor->join();
+            setActive(maxw);
+        }
+
+        int active() { return nactive; }
+
+        // A task was given to a worker
+        void sent() { nsent++; }
+
+        // A worker completed a task in us microseconds
+        void served(long us) {
+            busy += us;
+            ndone++;
+        }
+
+        // The worker id waits here while it is parked
+        void park(int id) {
+            if (id < nactive) return;
+            unique_lock<mutex> l(mtx);
+            wake.wait(l,[&]{ return id < nactive; });
+        }
+
+        // Mean number of active workers over the run
+        float meanActive() {
+            if (samples.empty()) return maxw;
+            float sum = 0;
+            for(auto& s : samples) sum += s.active;
+            return sum/samples.size();
+        }
+
+        // Trace of the active workers as CSV (time, active, in flight, service time)
+        void dump(const string path) {
+            ofstream out(path);
+            ERROR_MSG(!out.is_open(),"Error opening " << path)
+            out << "ms,active,inflight,service_us" << endl;
+            for(auto& s : samples)
+                out << s.ms << "," << s.active << "," << s.inflight << "," << s.service << "\n";
+        }
+};
@@ -1,41 +1,111 @@
-class ff_loader : public ff_node_t<void*,Mat> {
+class ff_loader : public ff_monode_t<void*,Batch> {
     private:
-        VideoCapture source; // Source of video
+        VideoCapture* source; // Source of video
+        string path;         // Path of the video (used by the segment decoders)
+        Options opt;         // Optional settings (decoders, batch size)
+        vector<int> local;   // Workers on the loader's NUMA node (empty = no preference)
+        size_t next = 0;     // Next local worker to try
+        Elastic* elastic;    // Tells which workers are active (nullptr = all)
+        long first;          // First frame to read (the source is positioned on it)
+        ReorderWindow* window; // Bounds the results waiting for their turn (nullptr = not ordered)
+
+        // Send the batch to a free active worker, the parked ones get nothing. While all the
+        // active workers are busy the loader sleeps, longer and longer up to 1 ms
+        void deliverActive(Batch* batch) {
+            for(int wait=1;;wait=min(2*wait,1000)) {
+                int n = elastic->active();
+                for(int i=0;i<n;i++) {
+                    int id = (next+i) % n;
+                    if (ff_send_out_to(batch,id,1)) {
+                        next = id+1;
+                        elastic->sent();
+                        return;
+                    }
+                }
+                std::this_thread::sleep_for(chrono::microseconds(wait));
+            }
+        }
+
+        // Send the batch preferably to a (free) worker of the loader's node, else to anyone
+        void deliver(Batch* batch) {
+            if (window) window->admit(batch->frames.front()->idx);
+            if (elastic) {
+                deliverActive(batch);
+                return;
+            }
+            for(size_t i=0;i<local.size();i++) {
+                int id = local[(next+i) % local.size()];
+                if (ff_send_out_to(batch,id,1)) {
+                    next = (next+i+1) % local.size();
+                    return;
+                }
+            }
+            ff_send_out(batch);
+        }
+
+        // The video is split in segments decoded in parallel, the loader forwards the frames
+        void forward_segments() {
+            SQueue q;
+            vector<SQueue*> queues(1,&q);
+            atomic<int> running;
+            vector<std::thread*> threads = start_decoders(path,frame_count(*source,opt),
+                                                     opt.decoders,opt.batch,&queues,&running,nullptr);
+            // the loader takes the first core of --pin-decoder, the decoders the next ones
+            for(size_t d=0;d<threads.size();d++)
+                NumaTopology::pin(threads[d],Affinity::at(opt.pin.decoder,d+1));
+            Batch* b;
+            while((b = q.get()) != nullptr) deliver(b);
+            for(auto t : threads) {
+                t->join();
+                delete t;
+            }
+        }
     public:
-        ff_loader(VideoCapture source): source(source) { }
+        ff_loader(VideoCapture* source,const string path,const Options opt,vector<int> local = vector<int>(),
+                  Elastic* elastic = nullptr,long first = 1,ReorderWindow* window = nullptr):
+            source(source),path(path),opt(opt),local(local),elastic(elastic),first(first),window(window) { }
+
+        Batch* svc(void**) {
 
-        Mat* svc(void**) {
+            if (opt.decoders > 1) {
+                forward_segments();
+                return EOS;
+            }
             
             Mat frame,*original;
 
             // We retrieve a shape of frames
-            int width  = source.get(CAP_PROP_FRAME_WIDTH);
-            int height = source.get(CAP_PROP_FRAME_HEIGHT);
-            int totalf = source.get(CAP_PROP_FRAME_COUNT)-1;
+            int width  = source->get(CAP_PROP_FRAME_WIDTH);
+            int height = source->get(CAP_PROP_FRAME_HEIGHT);
+            int totalf = frame_count(*source,opt)-1;
 
             // Number of byte used by RGB images
             int nbytes = sizeof(unsigned char)*width*height*3;
-            int c_frame = 0; // Number of frame seen
+            int c_frame = first-1; // Number of frame seen
+            BatchBuilder batches(opt.batch);
 
             // We send all frame of video
             // I cannot found a method to tranform a Mat to Mat pointer
             // A dummy way is to copy, but it's inefficent!
-            while(source.isOpened() && c_frame<totalf) {
+            while(source->isOpened() && c_frame<totalf) {
                 
-                ERROR_MSG(!source.read(frame),"Error in read frame operation")
+                ERROR_MSG(!source->read(frame),"Error in read frame operation")
 
                 original = new Mat(height,width,CV_8UC3,Scalar(0,0,0)); 
                 memcpy(original->data, frame.data, nbytes); 
 
-                // Send all frame  
-                ff_send_out(original);
+                // Send all frame (grouped in batches)
                 c_frame++;
+                Batch* batch = batches.add(new Frame(original,c_frame));
+                if (batch) deliver(batch);
             }
+            Batch* last = batches.flush();
+            if (last) deliver(last);
             return EOS;
         }
 };
 
-class ffa_worker : public ff_node_t<Mat,ushort> {
+class ffa_worker : public ff_node_t<Batch,Results> {
     private:
     int width,height;       // Shape of frame
     int dim,pixels;         // Kernel's dimention and frame's dimention
@@ -43,24 +113,30 @@ class ffa_worker : public ff_node_t<Mat,ushort> {
     Mat* background,*gray;  // Background image to compare,pointer to "reusable" grayscale image
     ulong totald;           // Total pixels that are different
     float k;                // Percentage
+    Elastic* elastic;       // Receives the service time (nullptr if not --elastic)
+    uint32_t grayus,blurus; // Time (us) of the gray and blur steps of the last frame
 
     public:
-    ffa_worker(VideoCapture source,int dx,Mat* background,float k):
-        dx(dx),background(background),dim((dx+dx+1)*(dx+dx+1)),k(k) {
+    ffa_worker(VideoCapture* source,int dx,Mat* background,float k,Elastic* elastic = nullptr):
+        dx(dx),background(background),dim((dx+dx+1)*(dx+dx+1)),k(k),elastic(elastic) {
 
-        this->width  = source.get(CAP_PROP_FRAME_WIDTH);
-        this->height = source.get(CAP_PROP_FRAME_HEIGHT);
+        this->width  = source->get(CAP_PROP_FRAME_WIDTH);
+        this->height = source->get(CAP_PROP_FRAME_HEIGHT);
         this->pixels = height * width;
-
-        // Reusable "frame" 
+    }
+    // Reusable "frame", it's allocated by the worker thread (first-touch on its node)
+    int svc_init() { 
         this->gray = new Mat(height+dx+dx,width+dx+dx,CV_8UC1,DEFAULT_IMG);
+        return 0;
     }
     void svc_end() { delete gray; }
 
-    ushort* svc(Mat* original) {
+    // Process one frame, returns the number of pixels that are different from background
+    ulong process(Mat* original) {
 
         int i,j,z,w;     // Counters
         float r,g,b,acc; // red,gree,blue & accomulator
+        auto t0 = chrono::steady_clock::now();
 
         // We take each RGB pixel and we tranform it into grayscale pixel
         for (i = 0; i < height; i++) {
@@ -71,7 +147,8 @@ class ffa_worker : public ff_node_t<Mat,ushort> {
                 gray->at<uchar>(i+dx, j+dx) = round(r+g+b);
             }
         }
-        delete original; // we need it no more
+        auto t1 = chrono::steady_clock::now();
+        grayus = stage_us(t0,t1);
 
         totald = 0;
 
@@ -87,29 +164,65 @@ class ffa_worker : public ff_node_t<Mat,ushort> {
                 totald += background->at<uchar>(i, j) - static_cast<uchar>(acc/dim) != 0;
             }
         }
-        // "Differents pixels" are divided by all pixels to obtain a percentage
-        // if perc > k then the frame is "different" from background
-        return new ushort((((float)totald )/pixels) > k);
+        blurus = stage_us(t1,chrono::steady_clock::now());
+        return totald;
+    }
+
+    // The frames of the batch are processed back to back, returns their results
+    Results* svc(Batch* batch) {
+
+        auto start = chrono::steady_clock::now();
+        Results* results = new Results();
+        for(Frame* frame : batch->frames) {
+            ulong different = process(frame->data);
+            delete frame->data; // we need it no more
+            frame->data = nullptr;
 
+            // "Differents pixels" are divided by all pixels to obtain a percentage
+            // if perc > k then the frame is "different" from background
+            results->push_back({frame->idx,different,(((float)different)/pixels) > k,grayus,blurus});
+        }
+        delete batch;
+        if (elastic) elastic->served(chrono::duration_cast<chrono::microseconds>(
+                                        chrono::steady_clock::now() - start).count());
+        return results;
     }
 
 };
 
-class ff_detect : public ff_node_t<ushort> {
+class ff_detect : public ff_node_t<Results> {
     private:
     ulong* total; // Total of frame "detected"
+    vector<ResultSink*> sinks; // Consumers of the results (in frame order)
+    long next = 1;             // Next frame to give to the sinks
+    ReorderWindow* window;     // Bounds the pending results (nullptr = not ordered)
+    // Results arrived before their turn
+    priority_queue<Result,vector<Result>,ResultAfter> pending;
 
     public:
-    ff_detect(ulong* total): total(total) {}
+    ff_detect(ulong* total,vector<ResultSink*> sinks = vector<ResultSink*>(),long first = 1,
+              ReorderWindow* window = nullptr):
+        total(total),sinks(sinks),next(first),window(window) {}
+
+    Results* svc(Results* results) {
+        for(auto& r : *results) {
+            *total += r.detected;
+            if (window) pending.push(r);
+        }
+        delete results;
 
-    ushort* svc(ushort* detected) {
-        *total += *detected;
-        delete detected;
+        while(!pending.empty() && pending.top().idx == next) {
+            for(auto s : sinks) s->put(pending.top());
+            pending.pop();
+            window->done(next++);
+        }
         return GO_ON;
     }
+    void svc_end() { for(auto s : sinks) s->end(); }
 };
 class fastflow_a {
     private:
+    string path;           // Path of the video
     VideoCapture* source;  // Source of video
     int width,height;      // Shapes of frame
     int totalf;            // Number of total frame in the video
@@ -118,15 +231,74 @@ class fastflow_a {
     int f_nw;              // Gray-worker(parfor) , Convolve-worker(parfor), Farm-Worker(Farm)
     Mat* background;       // Background images used for comparisons
     float k;               // Percentage
+    Options opt;           // Optional settings
+    NumaTopology* topo;    // NUMA layout (only with --numa)
+    vector<Mat*> backgrounds; // Background replica of each NUMA node
+    vector<ResultSink*> sinks; // Consumers of the ordered results
+    Elastic* elastic;      // Parks and wakes the workers (only with --elastic)
+    Checkpoint* checkpoint; // Checkpoint of the job (only with --checkpoint)
+    long first;            // First frame to analyze (after the watermark when resuming)
+    ReorderWindow* window; // Reorder window of the collector (only with --ordered)
 
     void cleanUp() {
         source->release();
         delete background;
+        for(auto b : backgrounds) delete b;
+        for(auto s : sinks) delete s;
+        delete checkpoint;
+        delete window;
+        delete elastic;
+        delete topo;
         delete source;
     }
+
+    // Run the farm, with --elastic the controller decides the active workers meanwhile.
+    // The parked workers get no task and, in blocking mode, sleep on their empty queue.
+    void run(ff_farm& farm) {
+        if (elastic) {
+            farm.blocking_mode(true);
+            elastic->start();
+        }
+        farm.run_and_wait_end();
+        if (elastic) elastic->stop();
+    }
+
+    void report() {
+        if (window) cout << "Reorder stalls: " << window->stalls() << endl;
+        if (checkpoint) cout << "Checkpoints: " << checkpoint->count() << " (" << checkpoint->time() << " us)" << endl;
+        if (!elastic) return;
+        cout << "Mean active workers: " << elastic->meanActive() << endl;
+        if (opt.trace != "") elastic->dump(opt.trace);
+    }
+
+    // Workers that live on the loader's node
+    vector<int> localWorkers() {
+        vector<int> local;
+        if (opt.numa)
+            for(int i=0;i<f_nw;i++) 
+                if (topo->nodeOf(i) == topo->loaderNode()) local.push_back(i);
+        return local;
+    }
+
+    // Pin the loader and the workers on their NUMA nodes, or the roles on the --pin-* cores
+    void placement(ff_loader& loader,vector<ff_node*>& workers,ff_detect& detect) {
+        if (opt.numa) {
+            loader.setAffinity(topo->loaderCpu());
+            for(int i=0;i<f_nw;++i) workers[i]->setAffinity(topo->cpuOf(i));
+        }
+        if (!opt.pin.decoder.empty()) loader.setAffinity(Affinity::at(opt.pin.decoder,0));
+        if (!opt.pin.workers.empty())
+            for(int i=0;i<f_nw;++i) workers[i]->setAffinity(Affinity::at(opt.pin.workers,i));
+        if (!opt.pin.collector.empty()) detect.setAffinity(Affinity::at(opt.pin.collector,0));
+    }
+
+    // Background used by the i-th worker
+    Mat* backgroundOf(int i) { return opt.numa ? backgrounds[topo->nodeOf(i)] : background; }
+
     public:
-    fastflow_a(const string path,const int ksize,const float k,const int f_nw):
-        f_nw(f_nw),k(k),dx(ksize/2) { 
+    fastflow_a(const string path,const int ksize,const float k,const int f_nw,const Options opt = Options()):
+        path(path),f_nw(f_nw),k(k),dx(ksize/2),opt(opt),topo(nullptr),elastic(nullptr),checkpoint(nullptr),first(1),
+        window(nullptr) { 
 
         // checking argument
         ERROR_MSG(path == "","path error")
@@ -134,39 +306,61 @@ class fastflow_a {
         ERROR_MSG(k<= 0 || k>1,"%'of pixel must be between 0 and 1")
         ERROR_MSG(f_nw<= 0,"ToGray workers must be more than 0")
 
-        this->source = new VideoCapture(path);
+        this->source = open_video(path);
 
         // check if the video is opened
         ERROR_MSG(!source->isOpened(),"Error opening video")
 
         this->width  = source->get(CAP_PROP_FRAME_WIDTH);
         this->height = source->get(CAP_PROP_FRAME_HEIGHT);
-        this->totalf = source->get(CAP_PROP_FRAME_COUNT);
+        this->totalf = frame_count(*source,opt);
 
         // We need at least 2 frame: one is the background, the other is the frame to compare
         ERROR_MSG(totalf<3,"Too short video")
   
-        // ---- First of all we retrieve the background ----
+        // A resumed job finds the background in the checkpoint
+        this->checkpoint = Checkpoint::open(opt,path,ksize,k,width,height);
+        if (checkpoint && checkpoint->resuming()) this->background = checkpoint->restore(source);
+        else {
+            // ---- First of all we retrieve the background ----
 
-        Mat frame,*gray;
-        // take the fist frame of the video
-        ERROR_MSG(!source->read(frame),"Error in read frame operation")
+            Mat frame,*gray;
+            // take the fist frame of the video
+            ERROR_MSG(!source->read(frame),"Error in read frame operation")
 
-        // tranform the RGB image into gray scale
-        gray = VideoDetect::static_toGray(frame,height,width,dx);
+            // tranform the RGB image into gray scale
+            gray = VideoDetect::static_toGray(frame,height,width,dx);
 
-        // Apply the convolution (smoothing)
-        this->background = VideoDetect::static_convolve(gray,height,width,dx);
+            // Apply the convolution (smoothing)
+            this->background = VideoDetect::static_convolve(gray,height,width,dx);
 
-        delete gray;
+            delete gray;
+        }
+        if (checkpoint) {
+            // the watermark follows the ordered results, the counters go on from the checkpoint
+            checkpoint->keep(background);
+            this->first = checkpoint->first();
+            this->totalDiff = checkpoint->detected();
+        }
+
+        if (opt.numa) {
+            this->topo = new NumaTopology(opt.decoders,f_nw);
+            this->backgrounds = topo->replicate(background);
+        }
+        this->sinks = make_sinks(opt,(long)width*height,checkpoint ? checkpoint->watermark() : 0);
+        if (checkpoint) sinks.push_back(new CheckpointSink(checkpoint,sinks));
+        // with --numa one worker per node stays active
+        if (opt.elastic > 0) this->elastic = new Elastic(f_nw,opt.elastic,opt.numa ? topo->nodes() : 1);
+        // by default the window can hold two batches per worker
+        if (opt.ordered) this->window = new ReorderWindow(opt.window > 0 ? opt.window : 2*f_nw*opt.batch,first);
     }
 
     void execute_to_result() {
 
         ff_farm farm;  
 
-        ff_loader loader(*source);
-        ff_detect ffa_detect(&totalDiff);
+        ff_loader loader(source,path,opt,localWorkers(),elastic,first,window);
+        ff_detect ffa_detect(&totalDiff,sinks,first,window);
 
         farm.add_collector(&ffa_detect);
         farm.add_emitter(&loader);
@@ -174,13 +368,15 @@ class fastflow_a {
         vector<ff_node*> workers(f_nw);
 
         for(int i=0;i<f_nw;++i) 
-            workers[i] = new ffa_worker(*source,dx,background,k);
+            workers[i] = new ffa_worker(source,dx,backgroundOf(i),k,elastic);
+        placement(loader,workers,ffa_detect);
         farm.add_workers(move(workers));
         farm.set_scheduling_ondemand();
         
-        farm.run_and_wait_end();
+        run(farm);
         cout << "Total frame: " << totalf << endl;
         cout << "Total diff: " << totalDiff << endl;
+        report();
         cleanUp();
         exit(0);
     }
@@ -189,22 +385,23 @@ class fastflow_a {
 
         ff_farm farm;  
 
-        ff_loader loader(*source);
-        ff_detect ffa_detect(&totalDiff);
+        ff_loader loader(source,path,opt,localWorkers(),elastic,first,window);
+        ff_detect ffa_detect(&totalDiff,sinks,first,window);
 
         farm.add_collector(&ffa_detect);
         farm.add_emitter(&loader);
 
         vector<ff_node*> workers(f_nw);
         for(int i=0;i<f_nw;++i) 
-            workers[i] = new ffa_worker(*source,dx,background,k);
+            workers[i] = new ffa_worker(source,dx,backgroundOf(i),k,elastic);
+        placement(loader,workers,ffa_detect);
         farm.add_workers(move(workers));
         farm.set_scheduling_ondemand();
 
         long el;
         {
             utimer u("",&el);
-            farm.run_and_wait_end();
+            run(farm);
         } 
         cout << el << endl;
         cleanUp();
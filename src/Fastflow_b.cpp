@@ -1,38 +1,95 @@
-class toGrayMap: public ff_Map<Mat> {
+// Grayscaled frames of a batch (and their indices), sent from the gray stage to the blur stage
+struct GrayBatch {
+    vector<Mat*> grays;
+    vector<long> idx;
+    // Wavefront mode: row bands of each frame already converted (published by the gray stage)
+    atomic<int>* bands = nullptr;
+
+    ~GrayBatch() { delete[] bands; }
+};
+
+class toGrayMap: public ff_Map<Batch,GrayBatch> {
     
     private:
     VideoCapture* source; // Source of video
     int width,height;     // Shape of frame
     int dx,nw;            // Number of total worker and "padding" (x grayscale)
+    int band;             // Rows per band in wavefront mode (0 = whole frames)
 
     public:
-    toGrayMap(VideoCapture* source,int dx,int nw): source(source),dx(dx),nw(nw) {
+    // The pool of the map has nw threads (by default it would have one per core)
+    toGrayMap(VideoCapture* source,int dx,int nw,int band = 0): ff_Map(nw),source(source),dx(dx),nw(nw),
+        band(band) {
 
         this->width  = source->get(CAP_PROP_FRAME_WIDTH);
         this->height = source->get(CAP_PROP_FRAME_HEIGHT);
     }
 
-    Mat *svc(Mat *original) {
-        // The node recieves a RGB image-> process (mapping)-> send a grayscaled frame
-        Mat* gray = new Mat(height+dx+dx,width+dx+dx,CV_8UC1,DEFAULT_IMG);
+    // Pin the threads of the pool (they do the conversion) on cpus, round-robin from the from-th one
+    void pinPool(const vector<int>& cpus,int from) {
+        const svector<ff_node*>& pool = pfr.getWorkers();
+        for(size_t t=0;t<pool.size();t++) pool[t]->setAffinity(cpus[(from+t) % cpus.size()]);
+    }
 
-        
+    // Convert the rows [r0,r1) of the frame
+    void toGrayRows(Mat *original,Mat *gray,int r0,int r1) {
         parallel_for(0,width,[&] (const long i) {
             float r,g,b;    
-            for (int h = 0; h < height; h++) {
+            for (int h = r0; h < r1; h++) {
                 r = 0.2989  * original->at<Vec3b>(h, i)[2];
                 g = 0.5870  * original->at<Vec3b>(h, i)[1];
                 b = 0.1140  * original->at<Vec3b>(h, i)[0];
                 gray->at<uchar>(h+dx, i+dx) = round(r+g+b);
             }
         },nw);
-        
-        delete original;
+    }
+
+    Mat *toGray(Mat *original) {
+        // The node recieves a RGB image-> process (mapping)-> send a grayscaled frame
+        Mat* gray = new Mat(height+dx+dx,width+dx+dx,CV_8UC1,DEFAULT_IMG);
+        toGrayRows(original,gray,0,height);
         return gray;
     }    
+
+    // Wavefront mode: the batch is sent to the blur stage before the conversion, then the
+    // frames are converted band by band and every completed band is published, so the blur
+    // can work on the first bands while the last ones are still being converted
+    GrayBatch *wavefront(Batch *batch) {
+        size_t n = batch->frames.size();
+        GrayBatch* grays = new GrayBatch();
+        grays->bands = new atomic<int>[n];
+        for(size_t f=0;f<n;f++) {
+            grays->grays.push_back(new Mat(height+dx+dx,width+dx+dx,CV_8UC1,DEFAULT_IMG));
+            grays->idx.push_back(batch->frames[f]->idx);
+            grays->bands[f] = 0;
+        }
+        this->ff_send_out(grays);
+
+        for(size_t f=0;f<n;f++)
+            for(int r0=0,b=1;r0<height;r0+=band,b++) {
+                toGrayRows(batch->frames[f]->data,grays->grays[f],r0,min(r0+band,height));
+                grays->bands[f].store(b,memory_order_release);
+            }
+        // grays belongs to the blur stage from here
+        delete batch;
+        return GO_ON;
+    }
+
+    GrayBatch *svc(Batch *batch) {
+        if (band > 0) return wavefront(batch);
+
+        // The frames of the batch are mapped one after the other
+        GrayBatch* grays = new GrayBatch();
+        for(Frame* frame : batch->frames) {
+            grays->grays.push_back(toGray(frame->data));
+            grays->idx.push_back(frame->idx);
+        }
+        delete batch;
+        return grays;
+    }
 };
 
-class toBlurMap: public ff_Map<Mat,ushort> {
+class toBlurMap: public ff_Map<GrayBatch,Results> {
     
     private:
     VideoCapture* source; // Source of video
@@ -41,24 +98,34 @@ class toBlurMap: public ff_Map<Mat,ushort> {
     int dx,nw;            // Padding and number of workers
     Mat* background;      // Background images used for comparisons
     float k;              // Percentage
+    Elastic* elastic;     // Receives the service time (nullptr if not --elastic)
+    int band;             // Rows per band in wavefront mode (0 = whole frames)
 
     public:
-    toBlurMap(VideoCapture* source,int dx,int nw,Mat* background,float k):
-     source(source),dx(dx),nw(nw),background(background),dim( (dx+dx+1)*(dx+dx+1) ),k(k) {
+    toBlurMap(VideoCapture* source,int dx,int nw,Mat* background,float k,Elastic* elastic = nullptr,
+              int band = 0):
+     ff_Map(nw),source(source),dx(dx),nw(nw),background(background),dim( (dx+dx+1)*(dx+dx+1) ),k(k),
+     elastic(elastic),band(band) {
 
         this->width  = source->get(CAP_PROP_FRAME_WIDTH);
         this->height = source->get(CAP_PROP_FRAME_HEIGHT);
         this->pixels = width*height;
     }
 
-    ushort* svc(Mat *gray) {
-        // The node recieves a grayscaled image-> process (mapping)-> send 1 or 0
+    // Pin the threads of the pool (they do the blur) on cpus, round-robin from the from-th one
+    void pinPool(const vector<int>& cpus,int from) {
+        const svector<ff_node*>& pool = pfr.getWorkers();
+        for(size_t t=0;t<pool.size();t++) pool[t]->setAffinity(cpus[(from+t) % cpus.size()]);
+    }
+
+    // Different pixels of the rows [r0,r1)
+    ulong blurRows(Mat *gray,int r0,int r1) {
         atomic<ulong> totald; // Total pixels that are different
         totald = 0 ;
         
         parallel_for(0,width,[&] (const long i) {
                 int z,w;float acc;
-                for (int h = 0; h < height; h++) {
+                for (int h = r0; h < r1; h++) {
                     acc = 0;
                     for(z=-dx;z<=dx;z++)for(w=-dx;w<=dx;w++) 
                             acc += gray->at<uchar>(h+dx+z,i+dx+w);
@@ -67,16 +134,50 @@ class toBlurMap: public ff_Map<Mat,ushort> {
                     totald += background->at<uchar>(h, i) - static_cast<uchar>(acc/dim) != 0;
                 }
         },nw);
+        return totald;
+    }
+
+    ulong blurDetect(Mat *gray,atomic<int>* bands = nullptr) {
+        // The node recieves a grayscaled image-> process (mapping)-> send the different pixels
+        ulong totald;
+        if (bands == nullptr) totald = blurRows(gray,0,height);
+        else {
+            // Wavefront: the band [r0,r1) needs the gray rows up to r1+dx
+            totald = 0;
+            for(int r0=0;r0<height;r0+=band) {
+                int r1 = min(r0+band,height);
+                int need = (min(r1+dx,height)+band-1)/band;
+                while(bands->load(memory_order_acquire) < need) this_thread::yield();
+                totald += blurRows(gray,r0,r1);
+            }
+        }
         delete gray;
 
-        // "Differents pixels" are divided by all pixels to obtain a percentage
-        // if perc > k then the frame is "different" from background
-        return new ushort((float)totald/pixels > k);
+        return totald;
     }    
+
+    Results* svc(GrayBatch *grays) {
+        auto start = chrono::steady_clock::now();
+        Results* results = new Results();
+        for(size_t f=0;f<grays->grays.size();f++) {
+            auto t0 = chrono::steady_clock::now();
+            ulong totald = blurDetect(grays->grays[f],grays->bands ? &grays->bands[f] : nullptr);
+            // "Differents pixels" are divided by all pixels to obtain a percentage
+            // if perc > k then the frame is "different" from background
+            // (the gray map is another stage, its time is not measured per frame)
+            results->push_back({grays->idx[f],totald,(float)totald/pixels > k,0,stage_us(t0,chrono::steady_clock::now())});
+        }
+        delete grays;
+        // the blur is the slowest stage, its time is the service time of the pipeline
+        if (elastic) elastic->served(chrono::duration_cast<chrono::microseconds>(
+                                        chrono::steady_clock::now() - start).count());
+        return results;
+    }
 };
 
 class fastflow_b {
     private:
+    string path;           // Path of the video
     VideoCapture* source;  // Source of video
     int width,height;      // Shapes of frame
     int totalf;            // Number of total frame in the video
@@ -85,15 +186,108 @@ class fastflow_b {
     int g_nw,c_nw,f_nw;    // Gray-worker(parfor) , Blurring-worker(parfor), Farm-Worker(Farm)
     Mat* background;       // Background images used for comparisons
     float k;               // Percentage
+    Options opt;           // Optional settings
+    NumaTopology* topo;    // NUMA layout (only with --numa)
+    vector<Mat*> backgrounds; // Background replica of each NUMA node
+    vector<ResultSink*> sinks; // Consumers of the ordered results
+    Elastic* elastic;      // Parks and wakes the pipelines (only with --elastic)
+    Checkpoint* checkpoint; // Checkpoint of the job (only with --checkpoint)
+    long first;            // First frame to analyze (after the watermark when resuming)
+    ReorderWindow* window; // Reorder window of the collector (only with --ordered)
+    long seqframe;         // Time (us) of the background frame done sequentially (0 = resumed)
 
     void cleanUp() {
         source->release();
         delete background;
+        for(auto b : backgrounds) delete b;
+        for(auto s : sinks) delete s;
+        delete checkpoint;
+        delete window;
+        delete elastic;
+        delete topo;
         delete source;
     }
+
+    // Run the farm, with --elastic the controller decides the active pipelines meanwhile
+    // (as in fastflow_a the parked ones sleep on their empty queue)
+    void run(ff_farm& farm) {
+        if (elastic) {
+            farm.blocking_mode(true);
+            elastic->start();
+        }
+        farm.run_and_wait_end();
+        if (elastic) elastic->stop();
+    }
+
+    // Fit the farm and the maps in opt.cores threads: the loader and the collector keep one
+    // core each, every pipeline needs at least one gray and one blur thread, and the cores of a pipeline
+    // are split between the two maps in proportion to their cost per pixel
+    // (3 products for the gray, ksize*ksize sums for the blur)
+    void budget() {
+        int avail = max(2,opt.cores-2);
+        f_nw = min(f_nw,avail/2);
+        int share = avail/f_nw;
+        int dim = (dx+dx+1)*(dx+dx+1);
+        g_nw = max(1,(int)round((float)share*3/(3+dim)));
+        c_nw = max(1,share-g_nw);
+    }
+
+    // Threads that can be busy at the same time: loader, collector and the maps of every pipeline
+    int threads() { return 2 + f_nw*(g_nw+c_nw); }
+
+    // Workers that live on the loader's node
+    vector<int> localWorkers() {
+        vector<int> local;
+        if (opt.numa)
+            for(int i=0;i<f_nw;i++) 
+                if (topo->nodeOf(i) == topo->loaderNode()) local.push_back(i);
+        return local;
+    }
+
+    // Build the i-th farm worker: a pipeline of two map stages, with --numa both stages
+    // are pinned on the worker's node and compare against the node's background.
+    // With --pin-workers the two stages take two consecutive cores of the list.
+    ff_pipeline* worker(int i) {
+        Mat* bg = opt.numa ? backgrounds[topo->nodeOf(i)] : background;
+        toGrayMap* gray = new toGrayMap(source,dx,g_nw,opt.wavefront);
+        toBlurMap* blur = new toBlurMap(source,dx,c_nw,bg,k,elastic,opt.wavefront);
+        if (opt.numa) {
+            gray->setAffinity(topo->cpuOf(i));
+            blur->setAffinity(topo->cpuOf(i));
+            // the stages only hand the frames to their pools, the pool threads do the work:
+            // they are spread over the cpus of the node, each worker of the node from its own slot
+            vector<int> cpus = topo->workerCpus(topo->nodeOf(i));
+            int slot = (i / topo->nodes()) * (g_nw+c_nw);
+            gray->pinPool(cpus,slot);
+            blur->pinPool(cpus,slot+g_nw);
+        }
+        if (!opt.pin.workers.empty()) {
+            gray->setAffinity(Affinity::at(opt.pin.workers,2*i));
+            blur->setAffinity(Affinity::at(opt.pin.workers,2*i+1));
+        }
+        if (!opt.pin.map.empty()) {
+            // the pool threads of all the pipelines take the --pin-map list one after the other
+            gray->pinPool(opt.pin.map,i*(g_nw+c_nw));
+            blur->pinPool(opt.pin.map,i*(g_nw+c_nw)+g_nw);
+        }
+        ff_pipeline* pipe = new ff_pipeline;
+        pipe->add_stage(gray);
+        pipe->add_stage(blur);
+        return pipe;
+    }
+
+    // Pin loader and collector (the threads of the map pools are pinned by worker())
+    void placement(ff_loader& loader,ff_detect& detect) {
+        if (opt.numa) loader.setAffinity(topo->loaderCpu());
+        if (!opt.pin.decoder.empty())   loader.setAffinity(Affinity::at(opt.pin.decoder,0));
+        if (!opt.pin.collector.empty()) detect.setAffinity(Affinity::at(opt.pin.collector,0));
+    }
+
     public:
-    fastflow_b(const string path,const int ksize,const float k,const int g_nw,const int c_nw,const int f_nw):
-        c_nw(c_nw),g_nw(g_nw),f_nw(f_nw),k(k),dx(ksize/2) { 
+    fastflow_b(const string path,const int ksize,const float k,const int g_nw,const int c_nw,const int f_nw,
+               const Options opt = Options()):
+        path(path),c_nw(c_nw),g_nw(g_nw),f_nw(f_nw),k(k),dx(ksize/2),opt(opt),topo(nullptr),elastic(nullptr),
+        checkpoint(nullptr),first(1),window(nullptr),seqframe(0) { 
 
         // checking argument
         ERROR_MSG(path == "","path error")
@@ -103,31 +297,57 @@ class fastflow_b {
         ERROR_MSG(c_nw<= 0,"ToGray workers must be more than 0")
         ERROR_MSG(f_nw<= 0,"ToGray workers must be more than 0")
 
-        this->source = new VideoCapture(path);
+        if (opt.cores > 0) budget();
+
+        this->source = open_video(path);
 
         // check if the video is opened
         ERROR_MSG(!source->isOpened(),"Error opening video")
 
         this->width  = source->get(CAP_PROP_FRAME_WIDTH);
         this->height = source->get(CAP_PROP_FRAME_HEIGHT);
-        this->totalf = source->get(CAP_PROP_FRAME_COUNT);
+        this->totalf = frame_count(*source,opt);
 
         // We need at least 2 frame: one is the background, the other is the frame to compare
         ERROR_MSG(totalf<3,"Too short video")
   
-        // ---- First of all we retrieve the background ----
+        // A resumed job finds the background in the checkpoint
+        this->checkpoint = Checkpoint::open(opt,path,ksize,k,width,height);
+        if (checkpoint && checkpoint->resuming()) this->background = checkpoint->restore(source);
+        else {
+            // ---- First of all we retrieve the background ----
+            // (done sequentially, its time gives the sequential-equivalent time of the run)
+            utimer u("",&seqframe);
 
-        Mat frame,*gray;
-        // take the fist frame of the video
-        ERROR_MSG(!source->read(frame),"Error in read frame operation")
+            Mat frame,*gray;
+            // take the fist frame of the video
+            ERROR_MSG(!source->read(frame),"Error in read frame operation")
 
-        // Tranform the RGB image into gray scale
-        gray = VideoDetect::static_toGray(frame,height,width,dx);
+            // Tranform the RGB image into gray scale
+            gray = VideoDetect::static_toGray(frame,height,width,dx);
 
-        // Apply the convolution (blurring)
-        this->background = VideoDetect::static_convolve(gray,height,width,dx);
+            // Apply the convolution (blurring)
+            this->background = VideoDetect::static_convolve(gray,height,width,dx);
 
-        delete gray;
+            delete gray;
+        }
+        if (checkpoint) {
+            // the watermark follows the ordered results, the counters go on from the checkpoint
+            checkpoint->keep(background);
+            this->first = checkpoint->first();
+            this->totalDiff = checkpoint->detected();
+        }
+
+        if (opt.numa) {
+            this->topo = new NumaTopology(opt.decoders,f_nw);
+            this->backgrounds = topo->replicate(background);
+        }
+        this->sinks = make_sinks(opt,(long)width*height,checkpoint ? checkpoint->watermark() : 0);
+        if (checkpoint) sinks.push_back(new CheckpointSink(checkpoint,sinks));
+        // with --numa one worker per node stays active
+        if (opt.elastic > 0) this->elastic = new Elastic(f_nw,opt.elastic,opt.numa ? topo->nodes() : 1);
+        // by default the window can hold two batches per pipeline
+        if (opt.ordered) this->window = new ReorderWindow(opt.window > 0 ? opt.window : 2*f_nw*opt.batch,first);
     }
 
     void execute_to_result() {
@@ -135,28 +355,45 @@ class fastflow_b {
         ff_farm farm;  
 
         // both are defined in fastflow_a.cpp
-        ff_loader loader(*source);
-        ff_detect detect(&totalDiff);
+        ff_loader loader(source,path,opt,localWorkers(),elastic,first,window);
+        // with --ordered the collector reorders the results of the pipelines by frame index
+        ff_detect detect(&totalDiff,sinks,first,window);
 
         farm.add_collector(&detect); // Collect the result
         farm.add_emitter(&loader);  // Send frames
 
 
         vector<ff_node*> workers(f_nw);
-        for(int i=0;i<f_nw;++i) {
-
-            // we are creating a pipiline with two stages
-            ff_pipeline* pipe = new ff_pipeline;
-            pipe->add_stage(new toGrayMap(source,dx,g_nw));
-            pipe->add_stage(new toBlurMap(source,dx,c_nw,background,k));
-            workers[i] = pipe;
-        }
+        // we are creating a pipiline with two stages
+        for(int i=0;i<f_nw;++i) workers[i] = worker(i);
+        placement(loader,detect);
         farm.add_workers(move(workers));
 
         farm.set_scheduling_ondemand();
-        farm.run_and_wait_end();
+        long elapsed;
+        {
+            utimer u("",&elapsed);
+            run(farm);
+        }
         cout << "Total frame: " << totalf << endl;
         cout << "Total diff: " << totalDiff << endl;
+        if (window) cout << "Reorder stalls: " << window->stalls() << endl;
+        if (checkpoint) cout << "Checkpoints: " << checkpoint->count() << " (" << checkpoint->time() << " us)" << endl;
+        if (elastic) {
+            cout << "Mean active workers: " << elastic->meanActive() << endl;
+            if (opt.trace != "") elastic->dump(opt.trace);
+        }
+
+        int cores = opt.cores > 0 ? opt.cores : ff_numCores();
+        cout << "Farm: " << f_nw << " x (gray " << g_nw << " + blur " << c_nw << ")" << endl;
+        cout << "Oversubscription: " << (float)threads()/cores << " (" << threads() << " threads on "
+             << cores << " cores)" << endl;
+        // the sequential version would take about as long as the background frame for every frame
+        if (seqframe > 0 && elapsed > 0) {
+            long sequential = seqframe*(totalf-first);
+            cout << "Speedup (estimated): " << (float)sequential/elapsed << " (sequential-equivalent "
+                 << sequential << " us, elapsed " << elapsed << " us)" << endl;
+        }
         cleanUp();
         exit(0);
     }
@@ -166,28 +403,25 @@ class fastflow_b {
         ff_farm farm;  
 
         // both are defined in fastflow_a.cpp
-        ff_loader loader(*source);
-        ff_detect detect(&totalDiff);
+        ff_loader loader(source,path,opt,localWorkers(),elastic,first,window);
+        // with --ordered the collector reorders the results of the pipelines by frame index
+        ff_detect detect(&totalDiff,sinks,first,window);
 
         farm.add_collector(&detect);
         farm.add_emitter(&loader);
 
 
         vector<ff_node*> workers(f_nw);
-        for(int i=0;i<f_nw;++i) {
-            // build worker pipeline 
-            ff_pipeline* pipe = new ff_pipeline;
-            pipe->add_stage(new toGrayMap(source,dx,g_nw));
-            pipe->add_stage(new toBlurMap(source,dx,c_nw,background,k));
-            workers[i] = pipe;
-        }
+        // build worker pipeline 
+        for(int i=0;i<f_nw;++i) workers[i] = worker(i);
+        placement(loader,detect);
         farm.add_workers(move(workers));
         farm.set_scheduling_ondemand();
 
         long el;
         {
             utimer u("",&el);
-            farm.run_and_wait_end();
+            run(farm);
         } 
         cout << el << endl;
         cleanUp();
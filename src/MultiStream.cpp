@@ -0,0 +1,269 @@
+/**
+ * @brief A video analyzed by the multi-stream engine, with its own parameters and counters
+ */
+struct Stream {
+    string path;            // Path of the video
+    VideoCapture* source;   // Source of video
+    int width,height;       // Shape of frame
+    int totalf;             // Number of total frame in the video
+    int dx,dim;             // "padding" and kernel's dimentions
+    long pixels;            // Frame's dimentions
+    float k;                // Percentage
+    Mat* background;        // Background images used for comparisons
+    long cost;              // Work of a frame (pixels*kernel), used by the scheduler
+
+    // Frames decoded and waiting for a worker, with the time they were queued
+    deque<pair<Frame*,chrono::steady_clock::time_point>> ready;
+    bool ended = false;     // The decoder has read all the frames
+    long deficit = 0;       // Credit of the deficit round-robin
+
+    atomic<ulong> detected{0},done{0}; // Frames "detected" and frames processed
+    atomic<ulong> latSum{0},latMax{0}; // Latency from queueing to result (us)
+    atomic<long> finish{0};            // When the last frame was completed (us from the start)
+
+    ~Stream() {
+        for(auto& p : ready) delete p.first;
+        source->release();
+        delete source;
+        delete background;
+    }
+};
+
+// Sixth implementation
+class MultiStream {
+
+    private:
+    vector<Stream*> streams;  // Videos to analyze
+    int nw;                   // Workers shared by all the streams
+    Options opt;              // Optional settings
+    mutex mtx;                // Protects the queues and the scheduler
+    condition_variable work,space;
+    size_t cur = 0;           // Stream whose turn it is
+    bool fresh = true;        // The current stream has not received its quantum yet
+    long quantum;             // Credit given to a stream at each turn (the biggest cost)
+    chrono::steady_clock::time_point start;
+
+    static const size_t QUEUE = 4; // Decoded frames waiting per stream
+
+    void cleanUp() { for(auto s : streams) delete s; }
+
+    long since() {
+        return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+    }
+
+    // Deficit round-robin: each turn a stream gains a quantum of credit and sends frames while
+    // its credit covers their cost, so the streams get the same work whatever their resolution
+    // and kernel. An empty stream loses its credit. (Called holding mtx)
+    bool pick(Stream*& s,Frame*& f,chrono::steady_clock::time_point& queued) {
+        size_t n = streams.size();
+        for(size_t scanned=0;scanned<=n;) {
+            Stream* c = streams[cur];
+            if (!c->ready.empty()) {
+                if (fresh) {
+                    c->deficit += quantum;
+                    fresh = false;
+                }
+                if (c->deficit >= c->cost) {
+                    c->deficit -= c->cost;
+                    s = c;
+                    f = c->ready.front().first;
+                    queued = c->ready.front().second;
+                    c->ready.pop_front();
+                    return true;
+                }
+            } else c->deficit = 0;
+            cur = (cur+1) % n;
+            fresh = true;
+            scanned++;
+        }
+        return false;
+    }
+
+    // Next frame for a worker, false when all the streams are over
+    bool take(Stream*& s,Frame*& f,chrono::steady_clock::time_point& queued) {
+        unique_lock<mutex> l(mtx);
+        while(1) {
+            if (pick(s,f,queued)) {
+                space.notify_all();
+                return true;
+            }
+            bool over = true;
+            for(auto c : streams) over = over && c->ended && c->ready.empty();
+            if (over) return false;
+            work.wait(l);
+        }
+    }
+
+    void decoder(Stream* s) {
+        int nbytes = sizeof(unsigned char)*s->width*s->height*3;
+        Mat frame,*original;
+        for(int f=1;f<s->totalf;f++) {
+            ERROR_MSG(!s->source->read(frame),"Error in read frame operation")
+            original = new Mat(s->height,s->width,CV_8UC3,Scalar(0,0,0));
+            memcpy(original->data, frame.data, nbytes);
+
+            unique_lock<mutex> l(mtx);
+            space.wait(l,[&]{ return s->ready.size() < QUEUE; });
+            s->ready.push_back({new Frame(original,f),chrono::steady_clock::now()});
+            work.notify_one();
+        }
+        lock_guard<mutex> l(mtx);
+        s->ended = true;
+        work.notify_all();
+    }
+
+    void worker() {
+        // A reusable grayscale image per stream (they have different shapes)
+        vector<Mat*> grays(streams.size(),nullptr);
+        Stream* s;
+        Frame* frame;
+        chrono::steady_clock::time_point queued;
+        int i,j,z,w;
+        float r,g,b,acc;
+
+        while(take(s,frame,queued)) {
+            size_t idx = find(streams.begin(),streams.end(),s) - streams.begin();
+            if (!grays[idx]) grays[idx] = new Mat(s->height+s->dx+s->dx,s->width+s->dx+s->dx,CV_8UC1,DEFAULT_IMG);
+            Mat* gray = grays[idx];
+            Mat* original = frame->data;
+            int dx = s->dx;
+
+            for (i = 0; i < s->height; i++) {
+                for (j = 0; j < s->width; j++){
+                    r = 0.2989  * original->at<Vec3b>(i, j)[2];
+                    g = 0.5870  * original->at<Vec3b>(i, j)[1];
+                    b = 0.1140  * original->at<Vec3b>(i, j)[0];
+                    gray->at<uchar>(i+dx, j+dx) = round(r+g+b);
+                }
+            }
+            ulong totald = 0;
+            for (i = 0; i < s->height ; i++) {
+                for (j = 0; j < s->width ; j++) {
+                    acc = 0;
+                    for(z=-dx;z<=dx;z++)for(w=-dx;w<=dx;w++)
+                            acc += gray->at<uchar>(i+dx+z,j+dx+w);
+                    totald += s->background->at<uchar>(i, j) - static_cast<uchar>(acc/s->dim) != 0;
+                }
+            }
+            delete frame;
+
+            s->detected += (((float)totald)/s->pixels) > s->k;
+            ulong lat = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - queued).count();
+            s->latSum += lat;
+            ulong seen = s->latMax;
+            while(lat > seen && !s->latMax.compare_exchange_weak(seen,lat));
+            s->done++;
+            s->finish = since();
+        }
+        for(auto g : grays) delete g;
+    }
+
+    void run() {
+        start = chrono::steady_clock::now();
+        vector<thread*> threads;
+        for(int i=0;i<nw;i++) {
+            threads.push_back(new thread(&MultiStream::worker,this));
+            NumaTopology::pin(threads.back(),Affinity::at(opt.pin.workers,i));
+        }
+        for(size_t i=0;i<streams.size();i++) {
+            threads.push_back(new thread(&MultiStream::decoder,this,streams[i]));
+            NumaTopology::pin(threads.back(),Affinity::at(opt.pin.decoder,i));
+        }
+        for(auto t : threads) {
+            t->join();
+            delete t;
+        }
+    }
+
+    // Open a stream and retrieve its background
+    Stream* open(const string path,int ksize,float k) {
+        ERROR_MSG(ksize < 3 || ksize%2==0,"kernel size must be >3 and odd (" << path << ")")
+        ERROR_MSG(k<= 0 || k>1,"%'of pixel must be between 0 and 1 (" << path << ")")
+
+        Stream* s = new Stream();
+        s->path = path;
+        s->source = open_video(path);
+        ERROR_MSG(!s->source->isOpened(),"Error opening video " << path)
+
+        s->width  = s->source->get(CAP_PROP_FRAME_WIDTH);
+        s->height = s->source->get(CAP_PROP_FRAME_HEIGHT);
+        s->totalf = frame_count(*s->source,opt);
+        ERROR_MSG(s->totalf<3,"Too short video " << path)
+        s->dx = ksize/2;
+        s->dim = ksize*ksize;
+        s->pixels = (long)s->width*s->height;
+        s->k = k;
+        s->cost = s->pixels*s->dim;
+
+        Mat frame,*gray;
+        ERROR_MSG(!s->source->read(frame),"Error in read frame operation")
+        gray = VideoDetect::static_toGray(frame,s->height,s->width,s->dx);
+        s->background = VideoDetect::static_convolve(gray,s->height,s->width,s->dx);
+        delete gray;
+        return s;
+    }
+
+    public:
+    /**
+     * @brief Many videos analyzed together by one pool of workers. Each video has its own
+     * decoder, background, kernel size and percentage, the workers take the frames of the
+     * videos with a deficit round-robin on the work of a frame.
+     *
+     * @param list File with a video per line: "path [ksize [k]]" (# starts a comment)
+     * @param ksize Kernel size of the videos that do not give it
+     * @param k Percentage of the videos that do not give it
+     * @param nw Number of workers
+     */
+    MultiStream(const string list,const int ksize,const float k,const int nw,const Options opt = Options()):
+        nw(nw),opt(opt) {
+
+        ERROR_MSG(list == "","A list of streams is needed (--streams=file)")
+        ERROR_MSG(nw<= 0,"Workers must be more than 0")
+
+        ifstream in(list);
+        ERROR_MSG(!in.is_open(),"Error opening " << list)
+        string line;
+        while(getline(in,line)) {
+            line = line.substr(0,line.find('#'));
+            stringstream ss(line);
+            string path;
+            int ks = ksize;
+            float kk = k;
+            if (!(ss >> path)) continue;
+            ss >> ks >> kk;
+            streams.push_back(open(path,ks,kk));
+        }
+        ERROR_MSG(streams.empty(),"No streams in " << list)
+
+        quantum = 0;
+        for(auto s : streams) quantum = max(quantum,s->cost);
+    }
+
+    void execute_to_result() {
+        run();
+        ulong frames = 0,diff = 0;
+        for(size_t i=0;i<streams.size();i++) {
+            Stream* s = streams[i];
+            cout << "Stream " << i << " (" << s->path << "): frames " << s->totalf << ", diff " << s->detected
+                 << ", " << (s->finish > 0 ? s->done*1000000.0/s->finish : 0) << " fps, latency "
+                 << s->latSum/max((ulong)1,s->done.load()) << " us (max " << s->latMax << " us)" << endl;
+            frames += s->totalf;
+            diff += s->detected;
+        }
+        cout << "Total frame: " << frames << endl;
+        cout << "Total diff: " << diff << endl;
+        cleanUp();
+        exit(0);
+    }
+
+    void execute_to_stat() {
+        long elapsed;
+        {
+            utimer u("",&elapsed);
+            run();
+        }
+        cout << elapsed << endl;
+        cleanUp();
+        exit(0);
+    }
+};
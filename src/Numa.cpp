@@ -0,0 +1,123 @@
+/**
+ * @brief Describes the NUMA layout of the machine (read from sysfs) and decides where
+ * the threads of an engine are placed. The workers are spread round-robin over the nodes,
+ * the decoders (loaders) take the first cpus of the nodes that have workers (round-robin,
+ * decoder 0 on node 0), so every decoder feeds a node whose queue is served. The workers
+ * take the cpus of their node after the decoders.
+ */
+class NumaTopology {
+
+    private:
+    vector<vector<int>> cpus; // Cpus of each NUMA node
+    int decoders;             // Number of decoding threads
+    int workers;              // Number of workers (0 = at least one on every node)
+
+    // Parse a sysfs cpu list such as "0-7,16-23"
+    static vector<int> parseCpuList(const string list) {
+        vector<int> res;
+        stringstream ss(list);
+        string range;
+        while(getline(ss,range,',')) {
+            if (range.empty()) continue;
+            size_t dash = range.find('-');
+            int from = stoi(range.substr(0,dash));
+            int to   = dash == string::npos ? from : stoi(range.substr(dash+1));
+            for(int c=from;c<=to;c++) res.push_back(c);
+        }
+        return res;
+    }
+
+    public:
+    NumaTopology(int decoders = 1,int workers = 0): decoders(decoders),workers(workers) {
+        for(int n=0;;n++) {
+            ifstream f("/sys/devices/system/node/node" + to_string(n) + "/cpulist");
+            if (!f.is_open()) break;
+            string list;
+            getline(f,list);
+            vector<int> c = parseCpuList(list);
+            if (!c.empty()) cpus.push_back(c);
+        }
+        // No NUMA information, the whole machine is a single node
+        if (cpus.empty()) {
+            vector<int> c;
+            for(int i=0;i<ff_numCores();i++) c.push_back(i);
+            cpus.push_back(c);
+        }
+    }
+
+    int nodes() const { return cpus.size(); }
+
+    // Nodes with at least one worker (the first ones, the workers are placed round-robin)
+    int served() const { return workers > 0 ? min(workers,nodes()) : nodes(); }
+
+    // Node and cpu of the d-th decoder
+    int decoderNode(int d) const { return d % served(); }
+    int decoderCpu(int d)  const { 
+        int node = decoderNode(d);
+        return cpus[node][(d / served()) % cpus[node].size()];
+    }
+
+    // Number of decoders placed on a node
+    int decodersOn(int node) const {
+        return node < served() ? decoders / served() + (node < decoders % served() ? 1 : 0) : 0;
+    }
+
+    // Node where the frames are decoded (by the single loader)
+    int loaderNode() const { return decoderNode(0); }
+    int loaderCpu()  const { return decoderCpu(0); }
+
+    // Node and cpu of the i-th worker
+    int nodeOf(int worker) const { return worker % nodes(); }
+    int cpuOf(int worker) const {
+        int node = nodeOf(worker);
+        // the first cpus of the node are already taken by the decoders
+        int slot = worker / nodes() + decodersOn(node);
+        return cpus[node][slot % cpus[node].size()];
+    }
+
+    // Cpus of a node left to the workers (the first ones are taken by the decoders)
+    vector<int> workerCpus(int node) const {
+        int taken = decodersOn(node);
+        if (taken >= (int)cpus[node].size()) return cpus[node];
+        return vector<int>(cpus[node].begin()+taken,cpus[node].end());
+    }
+
+    // Number of threads placed on a node when n threads are spread round-robin
+    int workersOn(int node,int n) const {
+        return n / nodes() + (node < n % nodes() ? 1 : 0);
+    }
+
+    /**
+     * @brief Pin a thread (pthread handle, e.g. std::thread::native_handle()) to one cpu
+     */
+    static void pin(pthread_t t,int cpu) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu,&set);
+        ERROR_MSG(pthread_setaffinity_np(t,sizeof(cpu_set_t),&set) != 0,"Cannot pin thread to cpu " << cpu)
+    }
+
+    // Pin a running std::thread through its native handle (cpu -1 = no pinning)
+    static void pin(std::thread* t,int cpu) {
+        if (cpu >= 0) pin(t->native_handle(),cpu);
+    }
+
+    /**
+     * @brief Make a copy of the image on every node. Each copy is allocated and written by
+     * a thread pinned on its node, so the pages are first-touched there.
+     *
+     * @param src Image to replicate
+     * @return vector<Mat*> one replica per node
+     */
+    vector<Mat*> replicate(const Mat* src) const {
+        vector<Mat*> replicas(nodes());
+        vector<thread> t;
+        for(int n=0;n<nodes();n++)
+            t.emplace_back([&,n] {
+                pin(pthread_self(),cpus[n][0]);
+                replicas[n] = new Mat(src->clone());
+            });
+        for(auto& th : t) th.join();
+        return replicas;
+    }
+};
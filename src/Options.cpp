@@ -0,0 +1,188 @@
+/**
+ * @brief Optional settings of the engines. They are given after the mandatory arguments
+ * in the form --name or --name=value, every engine receives the whole structure and
+ * reads only the fields it supports.
+ */
+struct Options {
+    bool numa = false; // Pin workers per NUMA node, replicate the background on each node
+    int decoders = 1;  // Number of threads decoding the video (each one a segment)
+    int batch = 1;     // Consecutive frames sent to a worker as a single task
+    string source = VIDEOSOURCE; // Path of the video
+    int tiles = 0;     // Tiles (row bands) per frame of the tile engine (0 = two per worker)
+    bool ordered = false; // Results are given downstream in frame order
+    int window = 0;    // Frames kept by the reorder buffer (0 = automatic)
+    string timeline = ""; // CSV file with the per-frame results (implies --ordered)
+    string counts = "";   // Binary file with the per-frame difference counts (implies --ordered)
+    string columns = "";  // Columnar binary file with the per-frame results (implies --ordered)
+    string events = "";   // CSV file with the motion events (implies --ordered)
+    int eventgap = 0;     // Undetected frames merged inside an event
+    int eventmin = 1;     // Frames of the shortest event
+    string checkpoint = ""; // Checkpoint file of the job, resumed if it exists (implies --ordered)
+    int checkpointevery = 1000; // Frames between two checkpoints
+    bool prefilter = false;   // Skip the frames that the compressed video tells static
+    long prefilterbytes = 0;  // Packets up to this size are static (0 = automatic)
+    bool prefiltermvs = false;   // Also the frames with zero motion vectors are static
+    bool prefiltercheck = false; // Analyze the static frames anyway and report the precision
+    string cacheraw = "";     // Directory of the raw frame caches (empty = the video is decoded)
+    int cores = 0;     // Thread budget of the farm of maps (0 = no budget)
+    int elastic = 0;   // Period (ms) of the elastic controller (0 = all the workers always active)
+    string trace = ""; // CSV file with the trace of the active workers (--elastic)
+    Affinity pin;      // Cores of each role (--pin-decoder, --pin-workers, --pin-collector, --pin-map)
+    int frames = 0;    // Frames to analyze after the background (0 = whole video)
+    int gray = 4;      // Threads of the gray map of version 3
+    int blur = 8;      // Threads of the blur map of version 3
+    int wavefront = 0; // Rows per band of the gray/blur wavefront of version 3 (0 = whole frames)
+    int width = 0,height = 0; // Shape of frame of a raw input (--size=WxH)
+    bool stream = false;      // The source is a pipe/FIFO ("-" = stdin) of raw frames
+    string pixfmt = "bgr24";  // Pixel format of the raw stream
+    bool shm = false;         // The source is the name of a shared-memory ring (e.g. /cam0)
+    string streams = "";      // File with the videos of the multi-stream engine
+    vector<int> ksizes;       // Kernel sizes of the sweep (empty = the kernel size argument)
+    vector<float> ks;         // Percentages of the sweep (empty = the percentage argument)
+    bool autotune = false; // Choose version and workers with calibration bursts
+    int tuneframes = 50;   // Frames of a calibration burst
+    string tunecache = "autotune.cache"; // Configurations found by the autotuner
+    vector<string> args;   // The optional arguments as given (forwarded by the autotuner)
+
+    // Comma separated list of numbers (e.g. 3,5,7)
+    static vector<float> numbers(const string value) {
+        vector<float> list;
+        stringstream ss(value);
+        string v;
+        while(getline(ss,v,',')) list.push_back(stof(v));
+        return list;
+    }
+
+    /**
+     * @brief Parse the optional arguments (argv[first] ... argv[argc-1])
+     */
+    static Options parse(int argc,char* argv[],int first) {
+        Options opt;
+        for(int i=first;i<argc;i++) {
+            string arg(argv[i]);
+            size_t eq = arg.find('=');
+            string name  = arg.substr(0,eq);
+            string value = eq == string::npos ? "" : arg.substr(eq+1);
+            opt.args.push_back(arg);
+
+            if (name == "--numa") opt.numa = true;
+            else if (name == "--decoders") opt.decoders = stoi(value);
+            else if (name == "--batch") opt.batch = stoi(value);
+            else if (name == "--source") opt.source = value;
+            else if (name == "--tiles") opt.tiles = stoi(value);
+            else if (name == "--ordered") opt.ordered = true;
+            else if (name == "--window") opt.window = stoi(value);
+            else if (name == "--timeline") { opt.timeline = value; opt.ordered = true; }
+            else if (name == "--counts") { opt.counts = value; opt.ordered = true; }
+            else if (name == "--columns") { opt.columns = value; opt.ordered = true; }
+            else if (name == "--events") { opt.events = value; opt.ordered = true; }
+            else if (name == "--event-gap") opt.eventgap = stoi(value);
+            else if (name == "--event-min") opt.eventmin = stoi(value);
+            else if (name == "--checkpoint") { opt.checkpoint = value; opt.ordered = true; }
+            else if (name == "--checkpoint-every") opt.checkpointevery = stoi(value);
+            else if (name == "--prefilter") { opt.prefilter = true; opt.prefilterbytes = value == "" ? 0 : stol(value); }
+            else if (name == "--prefilter-mvs") opt.prefilter = opt.prefiltermvs = true;
+            else if (name == "--prefilter-check") { opt.prefilter = opt.prefiltercheck = true; opt.ordered = true; }
+            else if (name == "--cache-raw") opt.cacheraw = value == "" ? "vmd-cache" : value;
+            else if (name == "--cores") opt.cores = stoi(value);
+            else if (name == "--elastic") opt.elastic = value == "" ? 100 : stoi(value);
+            else if (name == "--trace") opt.trace = value;
+            else if (name == "--pin-decoder") opt.pin.decoder = Affinity::parse(value);
+            else if (name == "--pin-workers") opt.pin.workers = Affinity::parse(value);
+            else if (name == "--pin-collector") opt.pin.collector = Affinity::parse(value);
+            else if (name == "--pin-map") opt.pin.map = Affinity::parse(value);
+            else if (name == "--frames") opt.frames = stoi(value);
+            else if (name == "--gray") opt.gray = stoi(value);
+            else if (name == "--blur") opt.blur = stoi(value);
+            else if (name == "--wavefront") opt.wavefront = value == "" ? 32 : stoi(value);
+            else if (name == "--stream") opt.stream = true;
+            else if (name == "--pix-fmt") opt.pixfmt = value;
+            else if (name == "--shm") opt.shm = true;
+            else if (name == "--streams") opt.streams = value;
+            else if (name == "--ksizes") for(auto v : numbers(value)) opt.ksizes.push_back(v);
+            else if (name == "--ks") opt.ks = numbers(value);
+            else if (name == "--size") {
+                size_t x = value.find('x');
+                ERROR_MSG(x == string::npos,"Wrong size " << value << " (WxH)")
+                opt.width  = stoi(value.substr(0,x));
+                opt.height = stoi(value.substr(x+1));
+            }
+            else if (name == "--autotune") opt.autotune = true;
+            else if (name == "--tune-frames") opt.tuneframes = stoi(value);
+            else if (name == "--tune-cache") opt.tunecache = value;
+            else ERROR_MSG(true,"Unknown option " << arg)
+        }
+        ERROR_MSG(opt.decoders <= 0,"Decoders must be more than 0")
+        ERROR_MSG(opt.batch <= 0,"Batch size must be more than 0")
+        ERROR_MSG(opt.window < 0,"Reorder window must be more than 0")
+        ERROR_MSG(opt.cores < 0,"Cores must be more than 0")
+        ERROR_MSG(opt.elastic < 0,"Elastic period must be more than 0")
+        ERROR_MSG(opt.numa && !opt.pin.empty(),"--numa already places the threads, it cannot be used with --pin-*")
+        ERROR_MSG(opt.frames < 0,"Frames must be more than 0")
+        ERROR_MSG(opt.shm && opt.stream,"--shm and --stream are two different sources")
+        ERROR_MSG(opt.tuneframes <= 0,"Calibration frames must be more than 0")
+        ERROR_MSG(opt.wavefront < 0,"Wavefront band must be more than 0")
+        ERROR_MSG(opt.eventgap < 0,"Event gap must be more than 0")
+        ERROR_MSG(opt.eventmin <= 0,"Event length must be more than 0")
+        ERROR_MSG(opt.checkpointevery <= 0,"Checkpoint period must be more than 0")
+        ERROR_MSG(opt.checkpoint != "" && (opt.stream || opt.shm),"--checkpoint needs a video file, a stream cannot be resumed")
+        ERROR_MSG(opt.prefilterbytes < 0,"Prefilter threshold must be more than 0")
+        ERROR_MSG(opt.prefilter && (opt.stream || opt.shm || opt.decoders > 1 || opt.numa),
+                  "--prefilter reads the packets of a video file, it cannot be used with --stream, --shm, --decoders and --numa")
+        ERROR_MSG(opt.cacheraw != "" && (opt.stream || opt.shm || opt.prefilter),
+                  "--cache-raw decodes a video file, it cannot be used with --stream, --shm and --prefilter")
+        // the segments are decoded together, their frames are too far apart to be reordered
+        ERROR_MSG(opt.ordered && opt.decoders > 1,"--ordered cannot be used with --decoders")
+        return opt;
+    }
+
+    // True if the option was given on the command line (for the ones with a default value)
+    bool given(const string name) const {
+        for(auto& arg : args)
+            if (arg.substr(0,arg.find('=')) == name) return true;
+        return false;
+    }
+
+    // The option that the version cannot run with, "" if it can run all of them
+    string unsupported(int version) const {
+        bool farm = version >= 1 && version <= 3; // the farms with a loader and a collector
+        if (checkpoint != "" && version > 3) return "--checkpoint";
+        if (prefilter && version > 1) return "--prefilter";
+        // the sinks imply --ordered, they are named first
+        if (timeline != "" && !farm) return "--timeline";
+        if (counts != "" && !farm) return "--counts";
+        if (columns != "" && !farm) return "--columns";
+        if (events != "" && !farm) return "--events";
+        // version 0 gives its results in order anyway (--checkpoint and --prefilter-check imply --ordered)
+        if (ordered && version > 3) return "--ordered";
+        if (window > 0 && !farm) return "--window";
+        if (numa && !farm) return "--numa";
+        if (decoders > 1 && !farm && version != 5) return "--decoders";
+        if (batch > 1 && !farm && version != 7) return "--batch";
+        if (elastic > 0 && !farm) return "--elastic";
+        if (cores > 0 && version != 3) return "--cores";
+        if (wavefront > 0 && version != 3) return "--wavefront";
+        if (given("--gray") && version != 3 && version != 5) return "--gray";
+        if (given("--blur") && version != 3) return "--blur";
+        if (tiles > 0 && version != 4) return "--tiles";
+        if (stream && version != 1) return "--stream";
+        if (shm && version != 1) return "--shm";
+        if (streams != "" && version != 6) return "--streams";
+        if (!ksizes.empty() && version != 7) return "--ksizes";
+        if (!ks.empty() && version != 7) return "--ks";
+        if (!pin.decoder.empty() && version == 0) return "--pin-decoder";
+        if (!pin.workers.empty() && version == 0) return "--pin-workers";
+        if (!pin.collector.empty() && !farm) return "--pin-collector";
+        if (!pin.map.empty() && version != 3 && version != 5) return "--pin-map";
+        return "";
+    }
+};
+
+/**
+ * @brief Number of frames of the video to consider (background included), with --frames
+ * only the first opt.frames frames after the background are analyzed
+ */
+int frame_count(VideoCapture& source,const Options& opt) {
+    int totalf = source.get(CAP_PROP_FRAME_COUNT);
+    return opt.frames > 0 ? min(totalf,opt.frames+1) : totalf;
+}
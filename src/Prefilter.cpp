@@ -0,0 +1,170 @@
+/**
+ * @brief Compressed-domain prefilter (--prefilter): before the frames are analyzed, the
+ * packets of the video are read with libavformat and the frames that are "certainly static"
+ * are marked. A frame is static when its packet is tiny (a camera that does not move codes an
+ * unchanged frame in a few bytes) or, with --prefilter-mvs, when all its motion vectors are
+ * zero. Keyframes are never static. The engines skip the pixel work of the static frames
+ * and give them as not detected (the sinks mark them as not analyzed). The frames are still
+ * grabbed to keep the decoder in step, and grab() decodes them: only the gray conversion,
+ * the blur and the comparison are saved, not the decoding. --prefilter-mvs decodes the
+ * whole video once more before the run to export the vectors, a second decoding pass.
+ *
+ * Only the builds with libav (cmake -DPREFILTER=ON, HAVE_LIBAV) can scan the packets.
+ */
+class Prefilter {
+    private:
+        vector<bool> marks;  // Certainly static frames, by index in display order
+        long threshold;      // Packets up to this size (bytes) are tiny
+        long nstill;         // Frames marked
+        long checked,wrong;  // Marked frames analyzed anyway, detected among them (--prefilter-check)
+
+#ifdef HAVE_LIBAV
+        struct Packet {
+            int64_t pts;    // Presentation time (the display order)
+            int size;       // Bytes of the packet
+            bool key;       // Keyframe
+        };
+
+        // Packets of the video stream in display order
+        static vector<Packet> packets(AVFormatContext* fmt,int stream) {
+            vector<Packet> list;
+            AVPacket* pkt = av_packet_alloc();
+            while(av_read_frame(fmt,pkt) >= 0) {
+                if (pkt->stream_index == stream)
+                    list.push_back({pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts,pkt->size,
+                                    (pkt->flags & AV_PKT_FLAG_KEY) != 0});
+                av_packet_unref(pkt);
+            }
+            av_packet_free(&pkt);
+            stable_sort(list.begin(),list.end(),[](const Packet& a,const Packet& b){ return a.pts < b.pts; });
+            return list;
+        }
+
+        // Default threshold: the unchanged frames are the floor of the non-key packets, twice
+        // their 10th percentile; on a video with few static frames that percentile is a moving
+        // frame, so the threshold is kept under 1% of the median keyframe
+        static long automatic(const vector<Packet>& list) {
+            vector<int> keys,others;
+            for(auto& p : list) (p.key ? keys : others).push_back(p.size);
+            if (others.empty()) return 0;
+            nth_element(others.begin(),others.begin()+others.size()/10,others.end());
+            long floor = 2*(long)others[others.size()/10];
+            if (keys.empty()) return floor;
+            nth_element(keys.begin(),keys.begin()+keys.size()/2,keys.end());
+            return min(floor,(long)keys[keys.size()/2]/100);
+        }
+
+        // Frames (display order) whose motion vectors are all zero: the video is decoded
+        // with the vectors exported, the pixels are not used
+        static vector<bool> zeroMotion(const string path,long frames) {
+            vector<bool> zero(frames,false);
+            AVFormatContext* fmt = nullptr;
+            ERROR_MSG(avformat_open_input(&fmt,path.c_str(),nullptr,nullptr) < 0,"Error opening video")
+            avformat_find_stream_info(fmt,nullptr);
+            const AVCodec* codec = nullptr;
+            int stream = av_find_best_stream(fmt,AVMEDIA_TYPE_VIDEO,-1,-1,&codec,0);
+            ERROR_MSG(stream < 0 || codec == nullptr,"No video stream in " << path)
+            AVCodecContext* ctx = avcodec_alloc_context3(codec);
+            avcodec_parameters_to_context(ctx,fmt->streams[stream]->codecpar);
+            AVDictionary* options = nullptr;
+            av_dict_set(&options,"flags2","+export_mvs",0);
+            ERROR_MSG(avcodec_open2(ctx,codec,&options) < 0,"Error opening the decoder of " << path)
+            av_dict_free(&options);
+
+            AVPacket* pkt = av_packet_alloc();
+            AVFrame* frame = av_frame_alloc();
+            long f = 0;
+            auto drain = [&]{
+                while(avcodec_receive_frame(ctx,frame) == 0) {
+                    const AVFrameSideData* sd = av_frame_get_side_data(frame,AV_FRAME_DATA_MOTION_VECTORS);
+                    // a frame without vectors is intra coded: it is not static
+                    bool still = sd != nullptr && frame->pict_type != AV_PICTURE_TYPE_I;
+                    if (still) {
+                        const AVMotionVector* mv = (const AVMotionVector*)sd->data;
+                        for(size_t i=0;i<sd->size/sizeof(AVMotionVector) && still;i++)
+                            still = mv[i].motion_x == 0 && mv[i].motion_y == 0;
+                    }
+                    if (f < frames) zero[f] = still;
+                    f++;
+                    av_frame_unref(frame);
+                }
+            };
+            while(av_read_frame(fmt,pkt) >= 0 && f < frames) {
+                if (pkt->stream_index == stream && avcodec_send_packet(ctx,pkt) == 0) drain();
+                av_packet_unref(pkt);
+            }
+            avcodec_send_packet(ctx,nullptr); // flush the delayed frames
+            drain();
+            av_frame_free(&frame);
+            av_packet_free(&pkt);
+            avcodec_free_context(&ctx);
+            avformat_close_input(&fmt);
+            return zero;
+        }
+#endif
+
+    public:
+        /**
+         * @param path Path of the video
+         * @param frames Frames to consider (background included)
+         * @param bytes Packets up to "bytes" are tiny (0 = automatic, see automatic())
+         * @param mvs Mark also the frames whose motion vectors are all zero
+         */
+        Prefilter(const string path,long frames,long bytes,bool mvs):
+            marks(frames,false),threshold(bytes),nstill(0),checked(0),wrong(0) {
+#ifdef HAVE_LIBAV
+            AVFormatContext* fmt = nullptr;
+            ERROR_MSG(avformat_open_input(&fmt,path.c_str(),nullptr,nullptr) < 0,"Error opening video")
+            avformat_find_stream_info(fmt,nullptr);
+            int stream = av_find_best_stream(fmt,AVMEDIA_TYPE_VIDEO,-1,-1,nullptr,0);
+            ERROR_MSG(stream < 0,"No video stream in " << path)
+            vector<Packet> list = packets(fmt,stream);
+            avformat_close_input(&fmt);
+
+            if (threshold == 0) threshold = automatic(list);
+            vector<bool> zero = mvs ? zeroMotion(path,frames) : vector<bool>();
+            // frame 0 is the background
+            for(long f=1;f<frames && f<(long)list.size();f++) {
+                bool still = !list[f].key && (list[f].size <= threshold || (mvs && zero[f]));
+                marks[f] = still;
+                nstill += still;
+            }
+#else
+            (void)path; (void)mvs;
+            ERROR_MSG(true,"--prefilter needs a build with libav (cmake -DPREFILTER=ON)")
+#endif
+        }
+
+        // Frame f is certainly static
+        bool still(long f) const { return f < (long)marks.size() && marks[f]; }
+
+        // --prefilter-check: the result of a marked frame that has been analyzed anyway
+        void verify(const Result& r) {
+            if (!still(r.idx)) return;
+            checked++;
+            wrong += r.detected;
+        }
+
+        // Marked frames that the full processing does not detect, over the marked ones
+        float precision() const { return checked == 0 ? 1 : 1 - (float)wrong/checked; }
+
+        void report(long frames) const {
+            cout << "Prefilter: " << nstill << " of " << frames-1 << " frames certainly static (packets <= "
+                 << threshold << " bytes)" << endl;
+            if (checked > 0)
+                cout << "Prefilter precision: " << precision() << " (" << wrong << " of " << checked
+                     << " marked frames detected by the full processing)" << endl;
+        }
+};
+
+/**
+ * @brief With --prefilter-check every frame is analyzed, the results of the marked ones
+ * measure the precision of the prefilter
+ */
+class PrefilterSink : public ResultSink {
+    private:
+        Prefilter* prefilter;
+    public:
+        PrefilterSink(Prefilter* prefilter): prefilter(prefilter) { }
+        void put(const Result& r) { prefilter->verify(r); }
+};
@@ -0,0 +1,178 @@
+/**
+ * @brief Header of a raw frame cache (--cache-raw), it fills the first page of the file.
+ * The frames follow, BGR row after row (as decoded by OpenCV), each one starting on a page
+ * boundary. The cache belongs to the video of "path" with that size and modification time.
+ */
+struct RawCacheHeader {
+    char magic[8];        // "VMDRAW"
+    uint32_t version;     // 1
+    int32_t width,height; // Shape of frame
+    int64_t frames;       // Frames of the video (background included)
+    int64_t stride;       // Bytes between the starts of two frames (a multiple of the page)
+    int64_t size,mtime;   // Size and modification time (s) of the video
+    char path[1024];      // Absolute path of the video
+};
+
+/**
+ * @brief Video decoded once into a raw frame file and mapped in memory. The first run with
+ * --cache-raw decodes the video into the cache, the next ones (the video is unchanged) read
+ * the frames straight from the mapping: with the page cache warm the engines measure the
+ * detection pipeline on the true content, without the decoder.
+ *
+ * It is a VideoCapture, the engines read it as any other video (seek included): a frame is
+ * a header on the mapping, nothing is copied.
+ */
+class RawCache : public VideoCapture {
+    private:
+        static const size_t PAGE = 4096; // Alignment of the header and of the frames
+        int fd;              // File descriptor of the cache
+        uchar* map;          // Mapping of the whole file
+        size_t length;       // Bytes of the file
+        RawCacheHeader h;
+        long pos;            // Next frame
+        bool opened;
+
+        static size_t align(size_t bytes) { return (bytes + PAGE-1)/PAGE*PAGE; }
+
+        // Header of the cache of a video, frames and stride are not known yet
+        static RawCacheHeader key(const string video) {
+            char full[PATH_MAX];
+            struct stat st;
+            ERROR_MSG(realpath(video.c_str(),full) == nullptr || stat(full,&st) != 0,"Error opening " << video)
+            ERROR_MSG(strlen(full) >= sizeof(RawCacheHeader::path),"Path too long " << video)
+            RawCacheHeader h = {{'V','M','D','R','A','W',0,0},1,0,0,0,0,st.st_size,st.st_mtime,{0}};
+            strcpy(h.path,full);
+            return h;
+        }
+
+        // The cache file exists and belongs to the video of the key
+        static bool valid(const string path,const RawCacheHeader& k) {
+            ifstream in(path,ios::binary);
+            RawCacheHeader old;
+            if (!in.is_open() || !in.read((char*)&old,sizeof(old))) return false;
+            return memcmp(old.magic,k.magic,8) == 0 && old.version == 1 && old.size == k.size &&
+                   old.mtime == k.mtime && strcmp(old.path,k.path) == 0 && old.frames > 0;
+        }
+
+        // Decode the whole video into the cache (a temporary file renamed at the end, one per
+        // process: two runs that build the same cache do not write the same file)
+        static void build(const string video,const string path,RawCacheHeader h) {
+            VideoCapture source(video);
+            ERROR_MSG(!source.isOpened(),"Error opening video")
+            h.width  = source.get(CAP_PROP_FRAME_WIDTH);
+            h.height = source.get(CAP_PROP_FRAME_HEIGHT);
+            size_t nbytes = (size_t)h.width*h.height*3;
+            h.stride = align(nbytes);
+
+            string tmp = path + "." + to_string(getpid()) + ".tmp";
+            ofstream out(tmp,ios::binary);
+            ERROR_MSG(!out.is_open(),"Error opening " << tmp)
+            vector<char> page(PAGE,0);
+            out.write(page.data(),PAGE); // the header is written when the frames are known
+            Mat frame;
+            while(source.read(frame)) {
+                ERROR_MSG(!frame.isContinuous() || frame.cols != h.width || frame.rows != h.height,
+                          "Unexpected frame in " << video)
+                out.write((const char*)frame.data,nbytes);
+                out.write(page.data(),h.stride-nbytes);
+                h.frames++;
+            }
+            source.release();
+            ERROR_MSG(h.frames == 0,"Too short video")
+            out.seekp(0);
+            out.write((const char*)&h,sizeof(h));
+            out.close();
+            ERROR_MSG(!out,"Error writing " << tmp)
+            ERROR_MSG(std::rename(tmp.c_str(),path.c_str()) != 0,"Error writing " << path)
+        }
+
+    public:
+        // True if the path is a raw frame cache
+        static bool accepts(const string path) {
+            return path.size() > 7 && path.compare(path.size()-7,7,".vmdraw") == 0;
+        }
+
+        /**
+         * @brief Cache of a video in the directory dir, decoded now if it is missing or the
+         * video has changed since
+         *
+         * @return string Path of the cache (the source of the engines)
+         */
+        static string prepare(const string video,const string dir) {
+            ERROR_MSG(accepts(video) || video.rfind("synthetic:",0) == 0,"--cache-raw needs a compressed video, " << video << " is not decoded")
+            RawCacheHeader k = key(video);
+            // the name tells the video, the hash of the absolute path tells videos with the same name
+            string name = k.path;
+            name = name.substr(name.rfind('/')+1);
+            stringstream path;
+            path << dir << "/" << name << "." << hex << std::hash<string>()(k.path) << ".vmdraw";
+            if (valid(path.str(),k)) {
+                cerr << "Raw cache: " << path.str() << endl;
+                return path.str();
+            }
+            mkdir(dir.c_str(),0755);
+            long elapsed;
+            {
+                utimer u("",&elapsed);
+                build(video,path.str(),k);
+            }
+            cerr << "Raw cache: " << video << " decoded into " << path.str() << " (" << elapsed << " us)" << endl;
+            return path.str();
+        }
+
+        RawCache(const string path): pos(0),opened(true) {
+            fd = ::open(path.c_str(),O_RDONLY);
+            ERROR_MSG(fd < 0,"Error opening video")
+            struct stat st;
+            ERROR_MSG(fstat(fd,&st) != 0,"Error opening video")
+            length = st.st_size;
+            ERROR_MSG(length < PAGE,"Wrong raw cache " << path)
+            // private and writable: a frame is a Mat the engines could write, the file stays intact
+            map = (uchar*)mmap(nullptr,length,PROT_READ|PROT_WRITE,MAP_PRIVATE,fd,0);
+            ERROR_MSG(map == MAP_FAILED,"Error mapping video")
+            memcpy(&h,map,sizeof(h));
+            ERROR_MSG(memcmp(h.magic,"VMDRAW",6) != 0 || h.version != 1 ||
+                      PAGE + (size_t)h.frames*h.stride > length,"Wrong raw cache " << path)
+            // the frames are taken in (nearly) increasing order
+            madvise(map,length,MADV_SEQUENTIAL);
+        }
+
+        ~RawCache() {
+            munmap(map,length);
+            close(fd);
+        }
+
+        bool isOpened() const override { return opened; }
+        void release() override { opened = false; }
+
+        double get(int prop) const override {
+            switch(prop) {
+                case CAP_PROP_FRAME_WIDTH:  return h.width;
+                case CAP_PROP_FRAME_HEIGHT: return h.height;
+                case CAP_PROP_FRAME_COUNT:  return h.frames;
+                case CAP_PROP_POS_FRAMES:   return pos;
+            }
+            return 0;
+        }
+
+        bool set(int prop,double value) override {
+            if (prop != CAP_PROP_POS_FRAMES || value < 0 || value > h.frames) return false;
+            pos = value;
+            return true;
+        }
+
+        bool grab() override {
+            if (!opened || pos >= h.frames) return false;
+            pos++;
+            return true;
+        }
+
+        // The frame grabbed last, a header on the mapping
+        bool retrieve(OutputArray image,int = 0) override {
+            if (pos == 0) return false;
+            image.assign(Mat(h.height,h.width,CV_8UC3,map + PAGE + (size_t)(pos-1)*h.stride));
+            return true;
+        }
+
+        bool read(OutputArray image) override { return grab() && retrieve(image); }
+};
@@ -0,0 +1,155 @@
+/**
+ * @brief Raw frames (no container) read from a pipe, a FIFO or the standard input ("-")
+ * until EOF, e.g. the output of "ffmpeg ... -f rawvideo -". The shape and the pixel format
+ * are given on the command line (--size, --pix-fmt) and the number of frames is unknown.
+ *
+ * A reader thread fills two buffers in turn: while the loader copies a frame, the next one
+ * is already being read (and converted to BGR), so the reader never stalls the workers.
+ * The reader waits for the input together with a wake-up pipe, so a stream closed before
+ * its end (--frames) stops the reader at once and joins it.
+ */
+class RawStream {
+    private:
+        int fd;              // Input (standard input or opened path)
+        int wake[2];         // Written by the destructor to stop a reader waiting for the input
+        int width,height;    // Shape of frame
+        string fmt;          // Pixel format of the input
+        size_t frameBytes;   // Bytes of a raw frame
+        vector<uchar> raw;   // Raw frame read from the input
+        Mat* buffers[2];     // BGR frames ready for the loader
+        bool full[2];        // True if the buffer holds a frame not yet taken
+        bool eof;            // The input has no more (complete) frames
+        bool stopped;        // The loader does not want more frames
+        int next;            // Buffer that the loader takes next
+        mutex mtx;
+        condition_variable c;
+        thread* reader;
+
+        // Read exactly n bytes, false at EOF (a partial frame at the end is dropped) or when
+        // the stream is closed
+        bool readFully(uchar* dest,size_t n) {
+            size_t got = 0;
+            while(got < n) {
+                pollfd p[2] = {{fd,POLLIN,0},{wake[0],POLLIN,0}};
+                if (poll(p,2,-1) < 0) {
+                    ERROR_MSG(errno != EINTR,"Error in read frame operation")
+                    continue;
+                }
+                if (p[1].revents) return false;
+                ssize_t r = ::read(fd,dest+got,n-got);
+                if (r == 0) return false;
+                if (r < 0 && errno == EINTR) continue;
+                ERROR_MSG(r < 0,"Error in read frame operation")
+                got += r;
+            }
+            return true;
+        }
+
+        static uchar clamp(float v) { return v < 0 ? 0 : v > 255 ? 255 : (uchar)round(v); }
+
+        // Convert the raw frame into a BGR image
+        void convert(Mat* dest) {
+            size_t pixels = (size_t)width*height;
+            uchar* d = dest->data;
+            if (fmt == "bgr24") memcpy(d,raw.data(),frameBytes);
+            else if (fmt == "rgb24")
+                for(size_t p=0;p<pixels;p++) {
+                    d[3*p] = raw[3*p+2]; d[3*p+1] = raw[3*p+1]; d[3*p+2] = raw[3*p];
+                }
+            else if (fmt == "gray")
+                for(size_t p=0;p<pixels;p++) d[3*p] = d[3*p+1] = d[3*p+2] = raw[p];
+            else { // yuv420p (BT.601 limited range: Y 16-235, U,V 16-240) or yuvj420p (full range)
+                const uchar* Y = raw.data();
+                const uchar* U = Y + pixels;
+                const uchar* V = U + (size_t)((width+1)/2)*((height+1)/2);
+                bool full = fmt == "yuvj420p";
+                float sy = full ? 1 : 255.0f/219,sc = full ? 1 : 255.0f/224,y0 = full ? 0 : 16;
+                for(int i=0;i<height;i++)
+                    for(int j=0;j<width;j++) {
+                        size_t p = (size_t)i*width+j,q = (size_t)(i/2)*((width+1)/2)+j/2;
+                        float y = (Y[p]-y0)*sy,u = (U[q]-128.0f)*sc,v = (V[q]-128.0f)*sc;
+                        d[3*p]   = clamp(y + 1.772f*u);
+                        d[3*p+1] = clamp(y - 0.344136f*u - 0.714136f*v);
+                        d[3*p+2] = clamp(y + 1.402f*v);
+                    }
+            }
+        }
+
+        void fill() {
+            int b = 0;
+            while(1) {
+                bool ok = readFully(raw.data(),frameBytes);
+                unique_lock<mutex> l(mtx);
+                if (!ok) {
+                    eof = true;
+                    c.notify_all();
+                    return;
+                }
+                c.wait(l,[&]{ return !full[b] || stopped; });
+                if (stopped) return;
+                l.unlock();
+                convert(buffers[b]);
+                l.lock();
+                full[b] = true;
+                c.notify_all();
+                b ^= 1;
+            }
+        }
+
+    public:
+        /**
+         * @param path Pipe or FIFO to read, "-" for the standard input
+         * @param width,height Shape of frame
+         * @param fmt Pixel format: bgr24, rgb24, gray, yuv420p or yuvj420p
+         */
+        RawStream(const string path,int width,int height,const string fmt):
+            width(width),height(height),fmt(fmt),eof(false),stopped(false),next(0) {
+
+            ERROR_MSG(width <= 0 || height <= 0,"A raw stream needs --size=WxH")
+            size_t pixels = (size_t)width*height;
+            if (fmt == "bgr24" || fmt == "rgb24") frameBytes = 3*pixels;
+            else if (fmt == "gray") frameBytes = pixels;
+            else if (fmt == "yuv420p" || fmt == "yuvj420p") frameBytes = pixels + 2*(size_t)((width+1)/2)*((height+1)/2);
+            else ERROR_MSG(true,"Unknown pixel format " << fmt)
+
+            fd = path == "-" ? STDIN_FILENO : open(path.c_str(),O_RDONLY);
+            ERROR_MSG(fd < 0,"Error opening video")
+            ERROR_MSG(pipe(wake) != 0,"Cannot create pipe")
+            raw.resize(frameBytes);
+            for(int b=0;b<2;b++) {
+                buffers[b] = new Mat(height,width,CV_8UC3,Scalar(0,0,0));
+                full[b] = false;
+            }
+            reader = new thread(&RawStream::fill,this);
+        }
+
+        ~RawStream() {
+            {
+                lock_guard<mutex> l(mtx);
+                stopped = true;
+            }
+            c.notify_all();
+            // stopped before EOF (--frames): the reader may be waiting for the input
+            ERROR_MSG(::write(wake[1],"",1) != 1,"Cannot stop the stream reader")
+            reader->join();
+            delete reader;
+            for(int b=0;b<2;b++) delete buffers[b];
+            if (fd != STDIN_FILENO) close(fd);
+            close(wake[0]);
+            close(wake[1]);
+        }
+
+        /**
+         * @brief Copy the next frame (BGR) into dest, false at the end of the stream
+         */
+        bool read(Mat* dest) {
+            unique_lock<mutex> l(mtx);
+            c.wait(l,[&]{ return full[next] || eof; });
+            if (!full[next]) return false;
+            memcpy(dest->data,buffers[next]->data,(size_t)width*height*3);
+            full[next] = false;
+            next ^= 1;
+            c.notify_all();
+            return true;
+        }
+};
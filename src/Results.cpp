@@ -0,0 +1,466 @@
+/**
+ * @brief Result of a single frame
+ */
+struct Result {
+    long idx;      // Index of the frame in the video
+    ulong totald;  // Pixels that are different from the background
+    ushort detected; // 1 if the frame is "different" from background
+    uint32_t gray = 0,blur = 0; // Time (us) of the gray and blur stages (0 = not measured)
+    bool skipped = false; // Not analyzed (static for --prefilter), given as not detected
+};
+
+// Results of the frames of a batch
+typedef vector<Result> Results;
+
+// Time (us) between two instants, for the stage times of a Result
+uint32_t stage_us(chrono::steady_clock::time_point from,chrono::steady_clock::time_point to) {
+    return chrono::duration_cast<chrono::microseconds>(to - from).count();
+}
+
+// Order of a min-heap on the frame index
+struct ResultAfter {
+    bool operator()(const Result& a,const Result& b) const { return a.idx > b.idx; }
+};
+
+/**
+ * @brief Consumer of the per-frame results, the results are given in frame order
+ * (--ordered). Used by the collectors to stream the results downstream.
+ */
+class ResultSink {
+    public:
+        virtual ~ResultSink() { }
+        virtual void put(const Result& r) = 0;
+        // Called after the last frame
+        virtual void end() { }
+        // Called before a checkpoint: every result given so far must be in the file
+        virtual void sync() { }
+};
+
+/**
+ * @brief Resume of a CSV sink: keeps the header and the rows whose column col is up to the
+ * watermark (the later ones are given again by the resumed job). False if there is no file.
+ */
+bool resume_csv(const string path,int col,long watermark) {
+    ifstream in(path);
+    string line,kept;
+    if (!getline(in,line)) return false;
+    kept = line + "\n";
+    while(getline(in,line)) {
+        stringstream ss(line);
+        string v;
+        for(int c=0;c<=col;c++) getline(ss,v,',');
+        if (stol(v) <= watermark) kept += line + "\n";
+    }
+    in.close();
+    ofstream out(path);
+    ERROR_MSG(!(out << kept),"Error writing " << path)
+    return true;
+}
+
+/**
+ * @brief Writes the per-frame timeline (frame, different pixels, detected) as CSV. A resumed
+ * job (watermark > 0) appends to the timeline of the frames up to the watermark.
+ */
+class TimelineSink : public ResultSink {
+    private:
+        ofstream out;
+    public:
+        TimelineSink(const string path,long watermark = 0) {
+            bool resumed = watermark > 0 && resume_csv(path,0,watermark);
+            out.open(path,resumed ? ios::app : ios::trunc);
+            ERROR_MSG(!out.is_open(),"Error opening " << path)
+            if (!resumed) out << "frame,totald,detected" << endl;
+        }
+        void put(const Result& r) {
+            if (r.skipped) return; // not analyzed, it has no count
+            out << r.idx << "," << r.totald << "," << r.detected << "\n";
+        }
+        void end() { out.flush(); }
+        void sync() { out.flush(); }
+};
+
+/**
+ * @brief Header of the file of the per-frame difference counts (--counts). It is followed
+ * by the counts of the frames in order (uint32) and by the same counts sorted inside blocks
+ * of "block" frames, that answer the threshold queries without reading every frame. A frame
+ * that has not been analyzed (--prefilter) has the count COUNT_SKIPPED, never detected.
+ */
+const uint32_t COUNT_SKIPPED = UINT32_MAX;
+
+struct CountsHeader {
+    char magic[4];    // "VMDC"
+    uint32_t block;   // Frames per sorted block
+    int64_t pixels;   // Pixels of a frame
+    int64_t first;    // Index of the first frame
+    int64_t frames;   // Number of frames
+};
+
+/**
+ * @brief Writes the difference count (totald) of every frame, k is not applied: the
+ * detections for any k are computed later from the file (see Counts)
+ *
+ * The file is written at the end, so a checkpointed job also appends the counts to
+ * path.part at every checkpoint (first frame, then the counts). A resumed job (watermark
+ * > 0) starts from the counts of path.part (or of the file of a completed run) up to the
+ * watermark.
+ */
+class CountsSink : public ResultSink {
+    private:
+        string path;
+        long pixels;
+        long first = -1;
+        vector<uint32_t> totald;
+        size_t synced = 0; // Counts already in path.part
+        bool ended = false;
+
+        // Counts of the frames up to the watermark from the file of a previous run
+        void resume(long watermark) {
+            int64_t from;
+            vector<uint32_t> counts;
+            ifstream part(path + ".part",ios::binary);
+            if (part.read((char*)&from,sizeof(from))) {
+                uint32_t t;
+                while(part.read((char*)&t,sizeof(t))) counts.push_back(t);
+            } else {
+                ifstream in(path,ios::binary);
+                CountsHeader h;
+                if (!in.read((char*)&h,sizeof(h)) || memcmp(h.magic,"VMDC",4) != 0) return;
+                from = h.first;
+                counts.resize(h.frames);
+                if (!in.read((char*)counts.data(),counts.size()*sizeof(uint32_t))) return;
+            }
+            if (from > watermark) return;
+            counts.resize(min<size_t>(counts.size(),watermark-from+1));
+            first = from;
+            totald = counts;
+        }
+
+    public:
+        CountsSink(const string path,long pixels,long watermark = 0): path(path),pixels(pixels) {
+            if (watermark > 0) resume(watermark);
+        }
+        void put(const Result& r) {
+            if (first < 0) first = r.idx;
+            totald.push_back(r.skipped ? COUNT_SKIPPED : r.totald);
+        }
+        void sync() {
+            if (ended || first < 0) return;
+            // the first sync writes the file again (it may hold frames after the watermark)
+            ofstream part(path + ".part",ios::binary | (synced > 0 ? ios::app : ios::trunc));
+            ERROR_MSG(!part.is_open(),"Error opening " << path << ".part")
+            if (synced == 0) {
+                int64_t from = first;
+                part.write((const char*)&from,sizeof(from));
+            }
+            part.write((const char*)(totald.data()+synced),(totald.size()-synced)*sizeof(uint32_t));
+            ERROR_MSG(!part,"Error writing " << path << ".part")
+            synced = totald.size();
+        }
+        void end() {
+            ended = true;
+            ofstream out(path,ios::binary);
+            ERROR_MSG(!out.is_open(),"Error opening " << path)
+            CountsHeader h = {{'V','M','D','C'},max<uint32_t>(1,sqrt(totald.size())),pixels,
+                              max(first,0L),(int64_t)totald.size()};
+            vector<uint32_t> sorted(totald);
+            for(size_t b=0;b<sorted.size();b+=h.block)
+                sort(sorted.begin()+b,sorted.begin()+min(sorted.size(),b+h.block));
+            out.write((const char*)&h,sizeof(h));
+            out.write((const char*)totald.data(),totald.size()*sizeof(uint32_t));
+            out.write((const char*)sorted.data(),sorted.size()*sizeof(uint32_t));
+            out.close();
+            if (synced > 0) std::remove((path + ".part").c_str());
+        }
+};
+
+/**
+ * @brief Header of the columnar file of the per-frame results (--columns). It is followed by
+ * chunks of rows: a ColumnsChunk and then the columns of its rows, one after the other:
+ * idx (int64), time (int64, us since the start), totald, gray, blur (uint32), detected
+ * (uint8), padded to 8 bytes.
+ */
+struct ColumnsHeader {
+    char magic[4];     // "VMDR"
+    uint32_t version;  // 1
+};
+
+struct ColumnsChunk {
+    uint32_t rows;     // Rows of the chunk
+    uint32_t bytes;    // Bytes of the columns that follow
+};
+
+/**
+ * @brief Writes the per-frame results in a columnar binary file. The collector only pushes
+ * the result in a lock-free ring, a writer thread lays out and writes the chunks. A resumed
+ * job (watermark > 0) appends to the rows up to the watermark, its times start again from 0.
+ */
+class ColumnsSink : public ResultSink {
+    private:
+        static const size_t CHUNK = 4096; // Rows per chunk
+        ofstream out;
+        SpscRing<pair<Result,int64_t>> ring;
+        atomic<bool> ended;
+        atomic<bool> syncing;  // The writer must write the rows it has (sync)
+        chrono::steady_clock::time_point start;
+        thread* writer;
+
+        // Resume: the file is cut before the chunk that crosses the watermark, the rows of
+        // that chunk up to the watermark are given back to be written again. False if there
+        // is no file to continue.
+        static bool resume(const string path,long watermark,vector<pair<Result,int64_t>>& rows) {
+            ifstream in(path,ios::binary);
+            ColumnsHeader h;
+            if (!in.read((char*)&h,sizeof(h)) || memcmp(h.magic,"VMDR",4) != 0) return false;
+            off_t pos = sizeof(h);
+            ColumnsChunk c;
+            while(in.read((char*)&c,sizeof(c))) {
+                vector<char> data(c.bytes);
+                if (!in.read(data.data(),c.bytes)) break; // cut by the end of the job
+                size_t n = c.rows;
+                const char* p = data.data();
+                int64_t idx;
+                memcpy(&idx,p+8*(n-1),8);
+                if (idx > watermark) {
+                    for(size_t i=0;i<n;i++) {
+                        pair<Result,int64_t> r = {};
+                        memcpy(&idx,p+8*i,8);
+                        if (idx > watermark) break;
+                        uint32_t totald;
+                        r.first.idx = idx;
+                        memcpy(&r.second,p+8*n+8*i,8);
+                        memcpy(&totald,p+16*n+4*i,4);
+                        r.first.totald = totald;
+                        memcpy(&r.first.gray,p+20*n+4*i,4);
+                        memcpy(&r.first.blur,p+24*n+4*i,4);
+                        r.first.detected = p[28*n+i];
+                        rows.push_back(r);
+                    }
+                    break;
+                }
+                pos += sizeof(c) + c.bytes;
+            }
+            in.close();
+            ERROR_MSG(::truncate(path.c_str(),pos) != 0,"Error writing " << path)
+            return true;
+        }
+
+        void write(const vector<pair<Result,int64_t>>& rows) {
+            size_t n = rows.size();
+            ColumnsChunk c = {(uint32_t)n,(uint32_t)((2*8+3*4+1)*n+7)/8*8};
+            vector<char> data(c.bytes,0);
+            char* p = data.data();
+            for(auto& r : rows) { memcpy(p,&r.first.idx,8); p += 8; }
+            for(auto& r : rows) { memcpy(p,&r.second,8); p += 8; }
+            for(auto& r : rows) { uint32_t v = r.first.totald; memcpy(p,&v,4); p += 4; }
+            for(auto& r : rows) { memcpy(p,&r.first.gray,4); p += 4; }
+            for(auto& r : rows) { memcpy(p,&r.first.blur,4); p += 4; }
+            for(auto& r : rows) *p++ = r.first.detected;
+            out.write((const char*)&c,sizeof(c));
+            out.write(data.data(),data.size());
+        }
+
+        void drain() {
+            vector<pair<Result,int64_t>> rows;
+            pair<Result,int64_t> r;
+            while(1) {
+                bool last = ended,sync = syncing;
+                while(ring.pop(r)) {
+                    rows.push_back(r);
+                    if (rows.size() == CHUNK) {
+                        write(rows);
+                        rows.clear();
+                    }
+                }
+                if (last) break;
+                if (sync) {
+                    // a shorter chunk: the rows pushed before the sync are in the file
+                    if (!rows.empty()) write(rows);
+                    rows.clear();
+                    out.flush();
+                    syncing = false;
+                }
+                this_thread::sleep_for(chrono::microseconds(100));
+            }
+            if (!rows.empty()) write(rows);
+            out.flush();
+        }
+
+    public:
+        ColumnsSink(const string path,long watermark = 0): ring(4*CHUNK),ended(false),syncing(false),
+            start(chrono::steady_clock::now()) {
+            vector<pair<Result,int64_t>> rows;
+            bool resumed = watermark > 0 && resume(path,watermark,rows);
+            out.open(path,ios::binary | (resumed ? ios::app : ios::trunc));
+            ERROR_MSG(!out.is_open(),"Error opening " << path)
+            ColumnsHeader h = {{'V','M','D','R'},1};
+            if (!resumed) out.write((const char*)&h,sizeof(h));
+            if (!rows.empty()) write(rows);
+            writer = new thread(&ColumnsSink::drain,this);
+        }
+        ~ColumnsSink() { end(); }
+
+        void put(const Result& r) {
+            if (r.skipped) return; // rows carry their frame index, a missing one was not analyzed
+            int64_t t = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+            while(!ring.push({r,t})) this_thread::yield();
+        }
+        void sync() {
+            if (writer == nullptr) return;
+            syncing = true;
+            Backoff b;
+            while(syncing) b.wait();
+        }
+        void end() {
+            if (writer == nullptr) return;
+            ended = true;
+            writer->join();
+            delete writer;
+            writer = nullptr;
+        }
+};
+
+/**
+ * @brief Groups the detected frames into motion events (start, end, peak fraction of
+ * different pixels) while the results arrive in frame order. Detected frames separated by at
+ * most "gap" undetected frames belong to the same event, events shorter than "min" frames
+ * are dropped. Only the open event is kept, each event is written (and flushed) as soon as
+ * it closes. A resumed job (watermark > 0) appends to the events that ended up to the
+ * watermark: an event still open at the watermark starts again from the resumed frames.
+ */
+class EventSink : public ResultSink {
+    private:
+        ofstream out;
+        long pixels;       // Pixels of a frame
+        long gap;          // Undetected frames that do not close an event
+        long min;          // Frames of the shortest event
+        bool open = false; // An event is in progress
+        long start,last;   // First and last detected frames of the open event
+        float peak;        // Highest fraction of different pixels of the open event
+
+        void close() {
+            if (last-start+1 >= min) out << start << "," << last << "," << last-start+1 << "," << peak << endl;
+            open = false;
+        }
+
+    public:
+        EventSink(const string path,long pixels,long gap,long min,long watermark = 0): pixels(pixels),gap(gap),min(min) {
+            bool resumed = watermark > 0 && resume_csv(path,1,watermark);
+            out.open(path,resumed ? ios::app : ios::trunc);
+            ERROR_MSG(!out.is_open(),"Error opening " << path)
+            if (!resumed) out << "start,end,frames,peak" << endl;
+        }
+        void put(const Result& r) {
+            if (!r.detected) { // also the frames not analyzed
+                // more than gap undetected frames: the event is final, it is written at once
+                if (open && r.idx-last > gap) close();
+                return;
+            }
+            if (open && r.idx-last-1 > gap) close();
+            float fraction = ((float)r.totald)/pixels;
+            if (!open) {
+                open = true;
+                start = r.idx;
+                peak = fraction;
+            }
+            last = r.idx;
+            peak = max(peak,fraction);
+        }
+        void end() { if (open) close(); }
+};
+
+/**
+ * @brief Reorder buffer used by the std::thread engines: the workers put their results in
+ * any order, a collector takes them in frame order. The window is bounded, a worker that
+ * is more than "window" frames ahead waits (reorder stall) until the older frames arrive.
+ */
+class ReorderBuffer {
+    private:
+        vector<Result> slots;  // Circular window of results
+        vector<bool> full;     // True if the slot holds a result
+        long next;             // Next frame to give out
+        size_t window;         // Size of the window
+        bool closed;           // No more results will be put
+        ulong nstalls;         // Number of puts that had to wait
+        mutex mtx;
+        condition_variable space,ready;
+
+    public:
+        ReorderBuffer(size_t window,long first): slots(window),full(window,false),
+            next(first),window(window),closed(false),nstalls(0) { }
+
+        void put(const Result& r) {
+            unique_lock<mutex> l(mtx);
+            if (r.idx >= next+(long)window) {
+                nstalls++;
+                space.wait(l,[&]{ return r.idx < next+(long)window; });
+            }
+            slots[r.idx%window] = r;
+            full[r.idx%window] = true;
+            if (r.idx == next) ready.notify_one();
+        }
+
+        // Take the next result in order, false when the buffer is closed and empty
+        bool get(Result& r) {
+            unique_lock<mutex> l(mtx);
+            ready.wait(l,[&]{ return full[next%window] || closed; });
+            if (!full[next%window]) return false;
+            r = slots[next%window];
+            full[next%window] = false;
+            next++;
+            space.notify_all();
+            return true;
+        }
+
+        void close() {
+            lock_guard<mutex> l(mtx);
+            closed = true;
+            ready.notify_all();
+        }
+
+        ulong stalls() {
+            lock_guard<mutex> l(mtx);
+            return nstalls;
+        }
+};
+
+/**
+ * @brief Reorder window of the FastFlow engines: the collector keeps the results that arrive
+ * before their turn, the loader waits (reorder stall) before sending a batch that starts
+ * "window" frames or more after the next result in order, so the collector keeps at most
+ * window+batch results.
+ */
+class ReorderWindow {
+    private:
+        atomic<long> next;     // Next frame given out by the collector
+        long window;           // Size of the window
+        atomic<ulong> nstalls; // Number of batches that had to wait
+
+    public:
+        ReorderWindow(long window,long first): next(first),window(window),nstalls(0) { }
+
+        // Called by the loader before sending the batch that starts at frame idx
+        void admit(long idx) {
+            if (idx < next.load(memory_order_acquire)+window) return;
+            nstalls++;
+            Backoff backoff;
+            while(idx >= next.load(memory_order_acquire)+window) backoff.wait();
+        }
+
+        // Called by the collector after giving out the frame idx
+        void done(long idx) { next.store(idx+1,memory_order_release); }
+
+        ulong stalls() { return nstalls; }
+};
+
+/**
+ * @brief Build the sinks requested by the options (the caller owns them). A job resumed from
+ * a checkpoint gives its watermark: the files of the sinks are continued after it.
+ */
+vector<ResultSink*> make_sinks(const Options& opt,long pixels,long watermark = 0) {
+    vector<ResultSink*> sinks;
+    if (opt.timeline != "") sinks.push_back(new TimelineSink(opt.timeline,watermark));
+    if (opt.counts != "") sinks.push_back(new CountsSink(opt.counts,pixels,watermark));
+    if (opt.columns != "") sinks.push_back(new ColumnsSink(opt.columns,watermark));
+    if (opt.events != "") sinks.push_back(new EventSink(opt.events,pixels,opt.eventgap,opt.eventmin,watermark));
+    return sinks;
+}
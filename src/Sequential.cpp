@@ -7,12 +7,33 @@ class Sequential {
     ulong totalDiff = 0 ; // Variable used to accomulate frame "detected"
     Mat* background;      // Background images used for comparisons
     int totalf,dx;        // Number of total frame in the video and "padding" (x grayscale)
+    Checkpoint* checkpoint = nullptr; // Checkpoint of the job (only with --checkpoint)
+    long first = 1;       // First frame to analyze (after the watermark when resuming)
+    Prefilter* prefilter = nullptr; // Static frames of the compressed video (only with --prefilter)
+    bool check = false;   // The static frames are analyzed anyway (--prefilter-check)
 
     void cleanUp() {
         source->release();
         delete background;
         delete source;
         delete vd;
+        delete checkpoint;
+        delete prefilter;
+    }
+
+    // Frame f has been analyzed: with --checkpoint it moves the watermark
+    void done(long f,ushort flag) {
+        totalDiff += flag;
+        if (checkpoint) checkpoint->advance({f,0,flag});
+        if (check) prefilter->verify({f,0,flag});
+    }
+
+    // A static frame (--prefilter) is only grabbed, it is not detected
+    bool skip(long f) {
+        if (!prefilter || check || !prefilter->still(f)) return false;
+        ERROR_MSG(!source->grab(),"Error in read frame operation")
+        done(f,0);
+        return true;
     }
     
     public:
@@ -23,8 +44,9 @@ class Sequential {
     * @param path Path of video to analyze
     * @param ksize Number of pixel per side (kernel = matrix of ksize*ksize)
     * @param k % of pixels that must be different to trigger "detection"
+    * @param opt Optional settings (--frames, --checkpoint and --prefilter)
     */
-    Sequential(const string path,const int ksize,const float k) {
+    Sequential(const string path,const int ksize,const float k,const Options opt = Options()) {
         
         // checking argument
         ERROR_MSG(path == "","path error")
@@ -32,7 +54,7 @@ class Sequential {
         ERROR_MSG(k<= 0 || k>1,"%'of pixel must be between 0 and 1")
 
         // VideoCapture class used to retrieve frames
-        this->source = new VideoCapture(path); 
+        this->source = open_video(path); 
 
         // Check if the video is opened
         ERROR_MSG(!source->isOpened(),"Error opening video")
@@ -40,7 +62,7 @@ class Sequential {
         // Some useful information
         this->width  = source->get(CAP_PROP_FRAME_WIDTH);
         this->height = source->get(CAP_PROP_FRAME_HEIGHT);
-        this->totalf = source->get(CAP_PROP_FRAME_COUNT);
+        this->totalf = frame_count(*source,opt);
         this->dx = ksize/2;
 
         // We need at least 2 frame: one is the background, the other is the frame to compare
@@ -48,24 +70,35 @@ class Sequential {
 
         // methods like ToGray, convolve ecc..
         this->vd = new VideoDetect(width,height,k,ksize);
+        this->checkpoint = Checkpoint::open(opt,path,ksize,k,width,height);
+        if (opt.prefilter) this->prefilter = new Prefilter(path,totalf,opt.prefilterbytes,opt.prefiltermvs);
+        this->check = opt.prefiltercheck;
+
+        if (checkpoint && checkpoint->resuming()) {
+            // The background is in the checkpoint, the video goes on after the watermark
+            this->background = checkpoint->restore(source);
+            this->first = checkpoint->first();
+            this->totalDiff = checkpoint->detected();
+        } else {
+            // ---- First of all we retrieve the background ----
+
+            Mat frame,*gray = new Mat(height+dx+dx,width+dx+dx,CV_8UC1,DEFAULT_IMG);
+            this->background = new Mat(height,width,CV_8UC1,DEFAULT_IMG);
+
+            // take the fist frame of the video
+            ERROR_MSG(!source->read(frame),"Error in read frame operation")
 
-        // ---- First of all we retrieve the background ----
-
-        Mat frame,*gray = new Mat(height+dx+dx,width+dx+dx,CV_8UC1,DEFAULT_IMG);
-        this->background = new Mat(height,width,CV_8UC1,DEFAULT_IMG);
-        
-        // take the fist frame of the video
-        ERROR_MSG(!source->read(frame),"Error in read frame operation")
-
-        // tranform the RGB image into gray scale
-        vd->toGray(frame,gray);
+            // tranform the RGB image into gray scale
+            vd->toGray(frame,gray);
 
-        // Apply the convolution (smoothing)
-        vd->convolve(gray,this->background);
+            // Apply the convolution (smoothing)
+            vd->convolve(gray,this->background);
+            delete gray;
+        }
 
         // Set the first frame as backgrounds
         vd->setBackground(this->background);
-        delete gray;
+        if (checkpoint) checkpoint->keep(background);
     }
 
     void execute_to_result() {
@@ -77,7 +110,9 @@ class Sequential {
         // We create the final image(frame) with the original dimensions
         Mat* blurred = new Mat(height,width,CV_8UC1,DEFAULT_IMG);
 
-        for(int f=0;f<totalf-1;f++) {
+        for(long f=first;f<totalf;f++) {
+            if (skip(f)) continue;
+
             // (1° step) Take next frame of video
             ERROR_MSG(!source->read(frame),"Error in read frame operation")
 
@@ -88,14 +123,17 @@ class Sequential {
             vd->convolve(gray,blurred);
 
             // (4° step) Detecting, returns 0 or 1 if "triggered" or not
-            totalDiff += vd->detect(blurred);
+            done(f,vd->detect(blurred));
         }
+        if (checkpoint) checkpoint->save();
         // clean memory on heap
         delete gray;
         delete blurred;
 
         cout << "Total frame: " << totalf << endl;
         cout << "Total diff: " << totalDiff << endl;
+        if (checkpoint) cout << "Checkpoints: " << checkpoint->count() << " (" << checkpoint->time() << " us)" << endl;
+        if (prefilter) prefilter->report(totalf);
 
         cleanUp();
         exit(0);
@@ -114,7 +152,9 @@ class Sequential {
         {   
             utimer u("",&elapsed);
 
-            for(int f=0;f<totalf-1;f++) {
+            for(long f=first;f<totalf;f++) {
+                if (skip(f)) continue;
+
                 // (1° step) Take next frame of video
                 ERROR_MSG(!source->read(frame),"Error in read frame operation")
 
@@ -125,8 +165,9 @@ class Sequential {
                 vd->convolve(gray,blurred);
 
                 // (4° step) Detecting, returns 0 or 1 if "triggered" or not
-                totalDiff += vd->detect(blurred);
+                done(f,vd->detect(blurred));
             }
+            if (checkpoint) checkpoint->save();
         }
         cout << elapsed << endl;
 
@@ -148,8 +189,9 @@ class Sequential {
 
         ulong tot_s1 = 0,tot_s2 = 0,tot_s3 = 0,tot_s4 = 0;
 
-        for(int f=1;f<totalf;f++) {
-            
+        for(long f=first;f<totalf;f++) {
+            if (skip(f)) continue;
+
             long elapsed;
             {   
                 utimer u("",&elapsed);
@@ -172,11 +214,12 @@ class Sequential {
             {   
                 utimer u("",&elapsed);
                 // (4° step) Detecting, returns 0 or 1 if "triggered" or not
-                this->totalDiff += vd->detect(blurred);
+                done(f,vd->detect(blurred));
             }
             tot_s4 += elapsed;
 
         }
+        if (checkpoint) checkpoint->save();
         cout << tot_s1 << "," << tot_s2 << "," << tot_s3 << "," << tot_s4 << endl;
         
         delete gray;
@@ -0,0 +1,296 @@
+/**
+ * @brief Client connected to the server, its jobs write their replies on the same socket.
+ * The socket is closed when the client has gone and its last job has replied.
+ */
+struct Connection {
+    int fd;
+    mutex mtx;    // One reply at a time
+
+    Connection(int fd): fd(fd) { }
+    ~Connection() { close(fd); }
+
+    void reply(const string line) {
+        lock_guard<mutex> l(mtx);
+        string s = line + "\n";
+        for(size_t sent=0;sent<s.size();) {
+            ssize_t n = send(fd,s.data()+sent,s.size()-sent,MSG_NOSIGNAL);
+            if (n <= 0) return; // the client has gone, the result is dropped
+            sent += n;
+        }
+    }
+};
+
+/**
+ * @brief A video submitted to the server: "path ksize k engine"
+ */
+struct Job {
+    long id;
+    string path;
+    int ksize,engine;
+    float k;
+    shared_ptr<Connection> client;
+
+    int width,height,dx;
+    Mat* background = nullptr;
+    VideoDetect* vd = nullptr;       // Gray conversion and detection of the job's frames (shared by the workers)
+    long frames = 0;                 // Frames analyzed (background excluded)
+    atomic<long> remaining{1};       // Frames not yet processed, +1 while the decoder runs
+    atomic<long> inflight{0};        // Frames given to the pool and not yet processed
+    mutex mtx;                       // The decoder sleeps here while inflight is at the limit
+    condition_variable drained;
+    atomic<ulong> detected{0};       // Frames "detected"
+    atomic<bool> started{false};     // The first frame has been taken by a worker
+    chrono::steady_clock::time_point arrival,start;
+
+    ~Job() {
+        delete vd;
+        delete background;
+    }
+};
+
+/**
+ * @brief Workers that live as long as the server and serve the frames of all the jobs. An
+ * idle worker spins for a while before sleeping, so the frames of a new job are taken at
+ * once.
+ */
+class WorkerPool {
+    private:
+        struct Task { Job* job; Frame* frame; };
+
+        deque<Task> tasks;
+        atomic<size_t> waiting{0};  // Tasks in the queue (read while spinning)
+        mutex mtx;
+        condition_variable c;
+        vector<thread*> workers;
+        function<void(Job*)> done;  // Called by the worker that completes a job
+
+        static const int SPIN = 20000; // Empty polls before sleeping
+
+        bool take(Task& t) {
+            for(int i=0;i<SPIN && waiting == 0;i++) this_thread::yield();
+            unique_lock<mutex> l(mtx);
+            c.wait(l,[&]{ return !tasks.empty(); });
+            t = tasks.front();
+            tasks.pop_front();
+            waiting--;
+            return true;
+        }
+
+        void worker() {
+            Mat* gray = nullptr; // reused while the shape does not change
+            Task t;
+
+            while(take(t)) {
+                Job* job = t.job;
+                Mat* original = t.frame->data;
+                int dx = job->dx;
+                if (!job->started.exchange(true)) job->start = chrono::steady_clock::now();
+                if (!gray || gray->rows != job->height+dx+dx || gray->cols != job->width+dx+dx) {
+                    delete gray;
+                    gray = new Mat(job->height+dx+dx,job->width+dx+dx,CV_8UC1,DEFAULT_IMG);
+                }
+                job->vd->toGray(*original,gray);
+                job->detected += job->vd->convolveDetect(gray);
+                delete t.frame;
+                {
+                    lock_guard<mutex> l(job->mtx);
+                    job->inflight--;
+                }
+                job->drained.notify_one();
+                if (--job->remaining == 0) done(job);
+            }
+            delete gray;
+        }
+
+    public:
+        WorkerPool(int nw,function<void(Job*)> done): done(done) {
+            for(int i=0;i<nw;i++) workers.push_back(new thread(&WorkerPool::worker,this));
+        }
+
+        size_t size() const { return workers.size(); }
+
+        void submit(Job* job,Frame* frame) {
+            lock_guard<mutex> l(mtx);
+            tasks.push_back({job,frame});
+            waiting++;
+            c.notify_one();
+        }
+};
+
+/**
+ * @brief Resident detection server: "main serve socket-path nw" listens on a Unix socket,
+ * each line received is a job "path ksize k engine" and each job gets a line back when it
+ * completes: "job id path: frames F, diff D, queued Q us, service S us" (or "job id error:
+ * ..."). The jobs run at the same time, their replies come in order of completion.
+ *
+ * Engine 1 farms the frames out to the pool of workers, started once with the server; engine
+ * 0 analyzes the video sequentially in the job's thread. The queueing time goes from the
+ * arrival of the job to its first processed frame, the service time from there to the end.
+ */
+class Server {
+    private:
+        string path;        // Path of the socket
+        WorkerPool pool;
+        atomic<long> jobs{0};
+
+        static long us(chrono::steady_clock::time_point from,chrono::steady_clock::time_point to) {
+            return chrono::duration_cast<chrono::microseconds>(to - from).count();
+        }
+
+        static void complete(Job* job) {
+            auto end = chrono::steady_clock::now();
+            stringstream ss;
+            ss << "job " << job->id << " " << job->path << ": frames " << job->frames+1 << ", diff "
+               << job->detected << ", queued " << us(job->arrival,job->start) << " us, service "
+               << us(job->start,end) << " us";
+            job->client->reply(ss.str());
+            delete job;
+        }
+
+        static void fail(Job* job,const string msg) {
+            job->client->reply("job " + to_string(job->id) + " error: " + msg);
+            delete job;
+        }
+
+        // Opens the video, computes the background and feeds the frames to the pool
+        void run(Job* job) {
+            if (job->ksize < 3 || job->ksize%2==0) return fail(job,"kernel size must be >3 and odd");
+            if (job->k <= 0 || job->k > 1) return fail(job,"%'of pixel must be between 0 and 1");
+            if (job->engine != 0 && job->engine != 1) return fail(job,"engine must be 0 or 1");
+            VideoCapture source(job->path);
+            if (!source.isOpened()) return fail(job,"Error opening video");
+
+            job->width  = source.get(CAP_PROP_FRAME_WIDTH);
+            job->height = source.get(CAP_PROP_FRAME_HEIGHT);
+            job->dx = job->ksize/2;
+            long totalf = source.get(CAP_PROP_FRAME_COUNT);
+
+            Mat frame,*gray;
+            if (totalf < 3 || !source.read(frame)) return fail(job,"Too short video");
+            gray = VideoDetect::static_toGray(frame,job->height,job->width,job->dx);
+            job->background = VideoDetect::static_convolve(gray,job->height,job->width,job->dx);
+            delete gray;
+            job->vd = new VideoDetect(job->width,job->height,job->k,job->ksize);
+            job->vd->setBackground(job->background);
+
+            if (job->engine == 0) {
+                job->start = chrono::steady_clock::now();
+                gray = new Mat(job->height+job->dx+job->dx,job->width+job->dx+job->dx,CV_8UC1,DEFAULT_IMG);
+                for(;job->frames<totalf-1 && source.read(frame);job->frames++) {
+                    job->vd->toGray(frame,gray);
+                    job->detected += job->vd->convolveDetect(gray);
+                }
+                delete gray;
+                return complete(job);
+            }
+
+            // At most two frames per worker of each job wait in the pool
+            long limit = 2*pool.size();
+            int nbytes = job->width*job->height*3;
+            for(long f=1;f<totalf && source.read(frame);f++) {
+                {
+                    unique_lock<mutex> l(job->mtx);
+                    job->drained.wait(l,[&]{ return job->inflight < limit; });
+                }
+                Mat* original = new Mat(job->height,job->width,CV_8UC3,Scalar(0,0,0));
+                memcpy(original->data,frame.data,nbytes);
+                job->frames++;
+                job->remaining++;
+                job->inflight++;
+                pool.submit(job,new Frame(original,f));
+            }
+            // no frame reached the pool: the job was served (empty) at once
+            if (job->frames == 0) job->start = chrono::steady_clock::now();
+            // the decoder's share, the job is over when the workers have finished too
+            if (--job->remaining == 0) complete(job);
+        }
+
+        // Reads the jobs of a client, one per line
+        void serve(int fd) {
+            shared_ptr<Connection> client = make_shared<Connection>(fd);
+            string buffer;
+            char data[1024];
+            ssize_t n;
+            while((n = recv(fd,data,sizeof(data),0)) > 0) {
+                buffer.append(data,n);
+                size_t eol;
+                while((eol = buffer.find('\n')) != string::npos) {
+                    string line = buffer.substr(0,eol);
+                    buffer.erase(0,eol+1);
+                    Job* job = new Job();
+                    job->id = ++jobs;
+                    job->client = client;
+                    job->arrival = chrono::steady_clock::now();
+                    stringstream ss(line);
+                    if (!(ss >> job->path >> job->ksize >> job->k >> job->engine)) {
+                        fail(job,"expected: path ksize k engine");
+                        continue;
+                    }
+                    thread(&Server::run,this,job).detach();
+                }
+            }
+        }
+
+    public:
+        /**
+         * @param path Path of the Unix socket
+         * @param nw Number of workers of the pool
+         */
+        Server(const string path,int nw): path(path),pool(nw,complete) {
+            ERROR_MSG(nw <= 0,"Workers must be more than 0")
+        }
+
+        void listen() {
+            int fd = socket(AF_UNIX,SOCK_STREAM,0);
+            ERROR_MSG(fd < 0,"Cannot create socket")
+            sockaddr_un addr = {};
+            addr.sun_family = AF_UNIX;
+            ERROR_MSG(path.size() >= sizeof(addr.sun_path),"Socket path too long")
+            strcpy(addr.sun_path,path.c_str());
+            unlink(path.c_str());
+            ERROR_MSG(::bind(fd,(sockaddr*)&addr,sizeof(addr)) != 0,"Cannot bind " << path)
+            ERROR_MSG(::listen(fd,64) != 0,"Cannot listen on " << path)
+            cerr << "Listening on " << path << " with " << pool.size() << " workers" << endl;
+            while(1) {
+                int client = accept(fd,nullptr,nullptr);
+                if (client < 0) continue;
+                thread(&Server::serve,this,client).detach();
+            }
+        }
+};
+
+/**
+ * @brief Client of the server: "main submit socket-path" sends the jobs read from the
+ * standard input (one per line) and prints the replies as they arrive
+ */
+void submit(int argc,char* argv[]) {
+    ERROR_MSG(argc < 3,"Wrong argument: submit socket-path < jobs")
+    int fd = socket(AF_UNIX,SOCK_STREAM,0);
+    ERROR_MSG(fd < 0,"Cannot create socket")
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path,argv[2],sizeof(addr.sun_path)-1);
+    ERROR_MSG(connect(fd,(sockaddr*)&addr,sizeof(addr)) != 0,"Cannot connect to " << argv[2])
+
+    long sent = 0;
+    string line;
+    while(getline(cin,line)) {
+        if (line.find_first_not_of(" \t") == string::npos) continue;
+        line += "\n";
+        ERROR_MSG(send(fd,line.data(),line.size(),MSG_NOSIGNAL) != (ssize_t)line.size(),"Cannot send the job")
+        sent++;
+    }
+    string buffer;
+    char data[1024];
+    ssize_t n;
+    while(sent > 0 && (n = recv(fd,data,sizeof(data),0)) > 0) {
+        buffer.append(data,n);
+        size_t eol;
+        while((eol = buffer.find('\n')) != string::npos) {
+            cout << buffer.substr(0,eol) << endl;
+            buffer.erase(0,eol+1);
+            sent--;
+        }
+    }
+    close(fd);
+}
@@ -0,0 +1,180 @@
+/**
+ * @brief Layout of the POSIX shared-memory ring of frames (shm_open name, e.g. /cam0), shared
+ * by a capture process (producer) and this program (consumer). All the fields are written by
+ * the producer when it creates the ring, except the ones noted.
+ *
+ *  offset 0           ShmHeader
+ *  sizeof(ShmHeader)  int64 state[slots]: frame held by the slot (readable), -1 if free
+ *  dataOffset         slots*slotBytes bytes: the frames, BGR24, row after row, no padding
+ *
+ * Frame n goes in slot n % slots. The producer waits until state[slot] == -1, writes the
+ * frame, stores state[slot] = n (release) and then published = n+1. A consumer reading frame n
+ * waits until state[slot] == n (acquire), reads the frame in place and gives the slot back
+ * with state[slot] = -1. The slots are released in any order. When the producer has no more
+ * frames it sets closed = 1, the frames from "published" on do not exist. A consumer that
+ * stops reading sets detached = 1, the producer does not wait for it any more.
+ */
+struct ShmHeader {
+    char magic[8];              // "VMDRING"
+    uint32_t version;           // 1
+    uint32_t width,height;      // Shape of frame
+    uint32_t slots;             // Frames in the ring
+    uint64_t slotBytes;         // Bytes of a frame (width*height*3)
+    uint64_t dataOffset;        // Offset of slot 0 (multiple of 4096)
+    atomic<int64_t> published;  // Frames written so far
+    atomic<uint32_t> closed;    // 1 when the producer has finished
+    atomic<uint32_t> detached;  // 1 when the consumer has finished (written by the consumer)
+};
+
+static_assert(atomic<int64_t>::is_always_lock_free,"the ring needs lock-free 64 bit atomics");
+
+/**
+ * @brief Shared-memory ring of frames (see ShmHeader), the frames are read in place
+ */
+class ShmRing {
+    private:
+        string name;         // Name of the shared memory object
+        int fd;
+        uchar* map;          // Mapping of the whole object
+        size_t length;       // Bytes of the object
+        ShmHeader* header;
+        atomic<int64_t>* state;
+        bool owner;          // Created by this process (the producer unlinks it)
+
+        // Wait with a short spin, then sleeping (the other side is another process)
+        template <typename Cond>
+        static void await(Cond ready) {
+            for(int i=0;!ready();i++)
+                if (i < 1000) this_thread::yield();
+                else this_thread::sleep_for(chrono::microseconds(50));
+        }
+
+        void attach(size_t bytes) {
+            length = bytes;
+            map = (uchar*)mmap(nullptr,length,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+            ERROR_MSG(map == MAP_FAILED,"Error mapping " << name)
+            header = (ShmHeader*)map;
+            state = (atomic<int64_t>*)(map + sizeof(ShmHeader));
+        }
+
+    public:
+        /**
+         * @brief Attach to the ring created by a producer
+         */
+        ShmRing(const string name): name(name),owner(false) {
+            fd = shm_open(name.c_str(),O_RDWR,0);
+            ERROR_MSG(fd < 0,"Error opening shared memory " << name << " (is the producer running?)")
+            struct stat st;
+            ERROR_MSG(fstat(fd,&st) != 0 || (size_t)st.st_size < sizeof(ShmHeader),"Wrong ring " << name)
+            attach(st.st_size);
+            ERROR_MSG(memcmp(header->magic,"VMDRING",8) != 0 || header->version != 1 ||
+                      header->dataOffset + header->slots*header->slotBytes > length,"Wrong ring " << name)
+        }
+
+        /**
+         * @brief Create a ring (producer side)
+         */
+        ShmRing(const string name,uint32_t width,uint32_t height,uint32_t slots): name(name),owner(true) {
+            ERROR_MSG(slots == 0,"The ring needs at least one slot")
+            fd = shm_open(name.c_str(),O_RDWR|O_CREAT|O_EXCL,0600);
+            ERROR_MSG(fd < 0,"Error creating shared memory " << name)
+            uint64_t slotBytes = (uint64_t)width*height*3;
+            uint64_t offset = (sizeof(ShmHeader) + slots*sizeof(int64_t) + 4095)/4096*4096;
+            ERROR_MSG(ftruncate(fd,offset + slots*slotBytes) != 0,"Error sizing shared memory " << name)
+            attach(offset + slots*slotBytes);
+            for(uint32_t s=0;s<slots;s++) new (&state[s]) atomic<int64_t>(-1);
+            new (&header->published) atomic<int64_t>(0);
+            new (&header->closed) atomic<uint32_t>(0);
+            new (&header->detached) atomic<uint32_t>(0);
+            header->width = width;
+            header->height = height;
+            header->slots = slots;
+            header->slotBytes = slotBytes;
+            header->dataOffset = offset;
+            header->version = 1;
+            atomic_thread_fence(memory_order_release);
+            memcpy(header->magic,"VMDRING",8);
+        }
+
+        ~ShmRing() {
+            if (!owner) header->detached.store(1,memory_order_release);
+            munmap(map,length);
+            close(fd);
+            if (owner) shm_unlink(name.c_str());
+        }
+
+        int cols() const { return header->width; }
+        int rows() const { return header->height; }
+        long published() const { return header->published; }
+
+        /**
+         * @brief Frame n (BGR, in place), nullptr if the producer closed the ring before it.
+         * The frame stays valid until release(n).
+         */
+        const uchar* acquire(long n) {
+            atomic<int64_t>& s = state[n % header->slots];
+            bool ended = false;
+            await([&]{
+                if (s.load(memory_order_acquire) == n) return true;
+                ended = header->closed.load(memory_order_acquire) && header->published <= n;
+                return ended;
+            });
+            return ended ? nullptr : map + header->dataOffset + (n % header->slots)*header->slotBytes;
+        }
+
+        void release(long n) { state[n % header->slots].store(-1,memory_order_release); }
+
+        // ---- Producer side ----
+
+        bool detached() const { return header->detached.load(memory_order_acquire); }
+
+        // Slot where frame n is written, after its previous frame has been released (nullptr
+        // if the consumer has detached)
+        uchar* slot(long n) {
+            atomic<int64_t>& s = state[n % header->slots];
+            await([&]{ return s.load(memory_order_acquire) == -1 || detached(); });
+            return detached() ? nullptr : map + header->dataOffset + (n % header->slots)*header->slotBytes;
+        }
+
+        void publish(long n) {
+            state[n % header->slots].store(n,memory_order_release);
+            header->published = n+1;
+        }
+
+        // No more frames, wait until the consumer has released them all
+        void finish() {
+            header->closed.store(1,memory_order_release);
+            for(uint32_t s=0;s<header->slots;s++)
+                await([&]{ return state[s].load(memory_order_acquire) == -1 || detached(); });
+        }
+};
+
+/**
+ * @brief Stand-in capture process: decodes a video into a new ring, for tests and benchmarks
+ * on one machine. "main produce /name path [slots [frames]]" (frames = 0: the whole video)
+ */
+void produce(int argc,char* argv[]) {
+    ERROR_MSG(argc < 4,"Wrong argument: produce /name path [slots [frames]]")
+    VideoCapture source(argv[3]);
+    ERROR_MSG(!source.isOpened(),"Error opening video")
+    int width  = source.get(CAP_PROP_FRAME_WIDTH);
+    int height = source.get(CAP_PROP_FRAME_HEIGHT);
+    long totalf = source.get(CAP_PROP_FRAME_COUNT);
+    uint32_t slots = argc > 4 ? stoi(argv[4]) : 16;
+    if (argc > 5 && stol(argv[5]) > 0) totalf = min(totalf,stol(argv[5]));
+
+    ShmRing ring(argv[2],width,height,slots);
+    Mat frame;
+    long elapsed,n;
+    {
+        utimer u("",&elapsed);
+        uchar* slot;
+        for(n=0;n<totalf && source.read(frame);n++) {
+            if ((slot = ring.slot(n)) == nullptr) break; // the consumer has finished
+            memcpy(slot,frame.data,(size_t)width*height*3);
+            ring.publish(n);
+        }
+        ring.finish();
+    }
+    cerr << "Produced " << n << " frames in " << elapsed << " us" << endl;
+}
@@ -0,0 +1,165 @@
+// Seventh implementation
+class Sweep {
+
+    private:
+    VideoCapture* source;     // Source of video
+    int width,height;         // Shape of frame
+    int totalf;               // Number of total frame in the video
+    long pixels;              // Frame's dimentions
+    int nw;                   // Number of workers
+    int D;                    // "padding" of the biggest kernel
+    vector<int> ksizes;       // Kernel sizes of the grid
+    vector<float> ks;         // Percentages of the grid
+    vector<Mat*> backgrounds; // Background of each kernel size
+    vector<vector<ulong>> grid; // Frames "detected" for each kernel size and percentage
+    mutex mtx;                // Protects the grid
+    Options opt;              // Optional settings
+
+    void cleanUp() {
+        source->release();
+        delete source;
+        for(auto b : backgrounds) delete b;
+    }
+
+    void worker(SQueue* queue) {
+        // One grayscale image padded for the biggest kernel serves all the kernels
+        Mat* gray = new Mat(height+D+D,width+D+D,CV_8UC1,DEFAULT_IMG);
+        int cols = width+D+D+1;
+        // Integral image: I[i][j] is the sum of the gray pixels above and to the left of (i,j)
+        vector<uint32_t> I((size_t)(height+D+D+1)*cols,0);
+        vector<vector<ulong>> local(ksizes.size(),vector<ulong>(ks.size(),0));
+        float r,g,b;
+        Batch* batch;
+
+        while((batch = queue->get()) != nullptr) {
+            for(auto f : batch->frames) {
+                Mat* original = f->data;
+                for (int i = 0; i < height; i++) {
+                    for (int j = 0; j < width; j++){
+                        r = 0.2989  * original->at<Vec3b>(i, j)[2];
+                        g = 0.5870  * original->at<Vec3b>(i, j)[1];
+                        b = 0.1140  * original->at<Vec3b>(i, j)[0];
+                        gray->at<uchar>(i+D, j+D) = round(r+g+b);
+                    }
+                }
+                for (int i = 0; i < height+D+D; i++) {
+                    uint32_t row = 0;
+                    for (int j = 0; j < width+D+D; j++) {
+                        row += gray->at<uchar>(i,j);
+                        I[(size_t)(i+1)*cols+j+1] = I[(size_t)i*cols+j+1] + row;
+                    }
+                }
+                // The box sum of every kernel costs four reads, whatever its size. The sums
+                // are integers, acc/dim is the same of the engines' accumulation
+                for(size_t s=0;s<ksizes.size();s++) {
+                    int dx = ksizes[s]/2,dim = ksizes[s]*ksizes[s];
+                    Mat* background = backgrounds[s];
+                    ulong totald = 0;
+                    for (int i = 0; i < height; i++) {
+                        const uint32_t* top = &I[(size_t)(i+D-dx)*cols];
+                        const uint32_t* bottom = &I[(size_t)(i+D+dx+1)*cols];
+                        for (int j = 0; j < width; j++) {
+                            float acc = bottom[j+D+dx+1] - top[j+D+dx+1] - bottom[j+D-dx] + top[j+D-dx];
+                            totald += background->at<uchar>(i, j) - static_cast<uchar>(acc/dim) != 0;
+                        }
+                    }
+                    for(size_t c=0;c<ks.size();c++) local[s][c] += (((float)totald)/pixels) > ks[c];
+                }
+            }
+            delete batch;
+        }
+        delete gray;
+
+        lock_guard<mutex> l(mtx);
+        for(size_t s=0;s<ksizes.size();s++)
+            for(size_t c=0;c<ks.size();c++) grid[s][c] += local[s][c];
+    }
+
+    void run() {
+        SQueue queue;
+        thread loader(loader_worker,source,&queue,totalf,opt.batch,1,nullptr,nullptr);
+        vector<thread*> workers;
+        for(int i=0;i<nw;i++) {
+            workers.push_back(new thread(&Sweep::worker,this,&queue));
+            NumaTopology::pin(workers.back(),Affinity::at(opt.pin.workers,i));
+        }
+        NumaTopology::pin(&loader,Affinity::at(opt.pin.decoder,0));
+        loader.join();
+        for(auto w : workers) {
+            w->join();
+            delete w;
+        }
+    }
+
+    public:
+    /**
+     * @brief Grid of detections for many kernel sizes (--ksizes) and percentages (--ks) in a
+     * single pass: every frame is decoded and grayscaled once, then an integral image gives
+     * the blur of any kernel size with four reads per pixel.
+     *
+     * @param path Path of video to analyze
+     * @param ksize Kernel size, if --ksizes is not given
+     * @param k Percentage, if --ks is not given
+     * @param nw Number of workers
+     * @param opt Optional settings: --ksizes, --ks, --batch, --frames
+     */
+    Sweep(const string path,const int ksize,const float k,const int nw,const Options opt = Options()):
+        nw(nw),opt(opt) {
+
+        ERROR_MSG(path == "","path error")
+        ERROR_MSG(nw<= 0,"Workers must be more than 0")
+        this->ksizes = opt.ksizes.empty() ? vector<int>{ksize} : opt.ksizes;
+        this->ks = opt.ks.empty() ? vector<float>{k} : opt.ks;
+        for(auto s : ksizes) ERROR_MSG(s < 3 || s%2==0 || s > 255,"kernel size must be >3, odd and <=255")
+        for(auto c : ks) ERROR_MSG(c<= 0 || c>1,"%'of pixel must be between 0 and 1")
+
+        this->source = open_video(path);
+        ERROR_MSG(!source->isOpened(),"Error opening video")
+
+        this->width  = source->get(CAP_PROP_FRAME_WIDTH);
+        this->height = source->get(CAP_PROP_FRAME_HEIGHT);
+        this->totalf = frame_count(*source,opt);
+        this->pixels = (long)width*height;
+        ERROR_MSG(totalf<3,"Too short video")
+
+        this->D = *max_element(ksizes.begin(),ksizes.end())/2;
+        grid.assign(ksizes.size(),vector<ulong>(ks.size(),0));
+
+        // ---- First of all we retrieve the backgrounds (one per kernel size) ----
+
+        Mat frame,*gray;
+        ERROR_MSG(!source->read(frame),"Error in read frame operation")
+        for(auto s : ksizes) {
+            gray = VideoDetect::static_toGray(frame,height,width,s/2);
+            backgrounds.push_back(VideoDetect::static_convolve(gray,height,width,s/2));
+            delete gray;
+        }
+    }
+
+    // The grid as CSV: a row per kernel size, a column per percentage
+    void execute_to_result() {
+        run();
+        cout << "ksize\\k";
+        for(auto c : ks) cout << "," << c;
+        cout << endl;
+        for(size_t s=0;s<ksizes.size();s++) {
+            cout << ksizes[s];
+            for(auto d : grid[s]) cout << "," << d;
+            cout << endl;
+        }
+        cout << "Total frame: " << totalf << endl;
+        cleanUp();
+        exit(0);
+    }
+
+    void execute_to_stat() {
+        long elapsed;
+        {
+            utimer u("",&elapsed);
+            run();
+        }
+        cout << elapsed << endl;
+        cleanUp();
+        exit(0);
+    }
+};
@@ -0,0 +1,97 @@
+/**
+ * @brief Synthetic video, "synthetic:WxHxN[:motion]" as source: N deterministic frames of
+ * WxH pixels generated in memory, nothing is decoded. Frame 0 (the background) is a fixed
+ * texture; every other frame is the texture with a band of rows inverted, the band covers
+ * the fraction "motion" of the pixels (default 0.1) and moves down frame after frame.
+ * A frame costs a copy of the texture and the inversion of the band, so the engines measure
+ * the gray, blur and detect stages and not the decoder.
+ *
+ * It is a VideoCapture, the engines read it as any other video (seek included).
+ */
+class SyntheticVideo : public VideoCapture {
+    private:
+        int width,height;  // Shape of frame
+        long frames;       // Frames of the video
+        float motion;      // Fraction of the pixels that change in each frame
+        int band;          // Rows of the moving band
+        long pos;          // Next frame
+        bool opened;
+        Mat texture;       // Frame 0
+
+    public:
+        static bool accepts(const string path) { return path.rfind("synthetic:",0) == 0; }
+
+        SyntheticVideo(const string path): motion(0.1),pos(0),opened(true) {
+            string spec = path.substr(strlen("synthetic:"));
+            size_t colon = spec.find(':');
+            if (colon != string::npos) {
+                motion = stof(spec.substr(colon+1));
+                spec = spec.substr(0,colon);
+            }
+            ERROR_MSG(sscanf(spec.c_str(),"%dx%dx%ld",&width,&height,&frames) != 3,
+                      "Wrong synthetic video " << path << " (synthetic:WxHxN[:motion])")
+            ERROR_MSG(width <= 0 || height <= 0 || frames <= 0,"Wrong synthetic video " << path)
+            ERROR_MSG(motion < 0 || motion > 1,"The motion of a synthetic video must be between 0 and 1")
+            band = round(motion*height);
+
+            texture.create(height,width,CV_8UC3);
+            for (int i = 0; i < height; i++) {
+                uchar* p = texture.ptr<uchar>(i);
+                for (int j = 0; j < width; j++)
+                    for (int c = 0; c < 3; c++) *p++ = (i*7 + j*13 + c*29 + ((i*j)>>4)) & 255;
+            }
+        }
+
+        bool isOpened() const override { return opened; }
+        void release() override { opened = false; }
+
+        double get(int prop) const override {
+            switch(prop) {
+                case CAP_PROP_FRAME_WIDTH:  return width;
+                case CAP_PROP_FRAME_HEIGHT: return height;
+                case CAP_PROP_FRAME_COUNT:  return frames;
+                case CAP_PROP_POS_FRAMES:   return pos;
+                case CAP_PROP_FPS:          return 25;
+            }
+            return 0;
+        }
+
+        bool set(int prop,double value) override {
+            if (prop != CAP_PROP_POS_FRAMES || value < 0 || value > frames) return false;
+            pos = value;
+            return true;
+        }
+
+        bool grab() override {
+            if (!opened || pos >= frames) return false;
+            pos++;
+            return true;
+        }
+
+        // The frame grabbed last
+        bool retrieve(OutputArray image,int = 0) override {
+            if (pos == 0) return false;
+            long f = pos-1;
+            image.create(height,width,CV_8UC3);
+            Mat m = image.getMat();
+            for (int i = 0; i < height; i++) memcpy(m.ptr<uchar>(i),texture.ptr<uchar>(i),(size_t)width*3);
+            if (f == 0 || band == 0) return true;
+            int first = (f*max(1,band/4)) % (height-band+1);
+            for (int i = first; i < first+band; i++) {
+                uchar* p = m.ptr<uchar>(i);
+                for (int j = 0; j < width*3; j++) p[j] = 255-p[j];
+            }
+            return true;
+        }
+
+        bool read(OutputArray image) override { return grab() && retrieve(image); }
+};
+
+/**
+ * @brief Open the video of a path: a synthetic video, a raw frame cache or a file read by OpenCV
+ */
+VideoCapture* open_video(const string path) {
+    if (SyntheticVideo::accepts(path)) return new SyntheticVideo(path);
+    if (RawCache::accepts(path)) return new RawCache(path);
+    return new VideoCapture(path);
+}
@@ -4,86 +4,335 @@ atomic<ulong> totalDiff(0) ; // Variable used to accomulate frame "detected"
  * @brief This thread handles a loader phase, infact retrieve all frame and put them into queue 
  * @param source Video capture pointer (read frame)
  * @param queue queue to insert the frame read
+ * @param totalf number of frames to read (background included)
+ * @param B number of frames per batch
+ * @param first first frame to read (the source is positioned on it)
+ * @param prefilter the static frames are only grabbed (decoded, not analyzed) and given as
+ * not detected (nullptr = none)
+ * @param reorder buffer where the results of the static frames are put (nullptr if not --ordered)
  */
-void loader_worker(VideoCapture* source,SQueue* queue) {
+void loader_worker(VideoCapture* source,SQueue* queue,int totalf,int B,long first = 1,
+                   Prefilter* prefilter = nullptr,ReorderBuffer* reorder = nullptr) {
 
     int width  = source->get(CAP_PROP_FRAME_WIDTH);
     int height = source->get(CAP_PROP_FRAME_HEIGHT);
-    int totalf = source->get(CAP_PROP_FRAME_COUNT);
     int nbytes = sizeof(unsigned char)*width*height*3;
 
     Mat frame,*original;
-    for(int f=0;f<totalf-1;f++) {
-
+    BatchBuilder batches(B);
+    for(int f=first-1;f<totalf-1;f++) {
+
+        if (prefilter && prefilter->still(f+1)) {
+            source->grab();
+            if (reorder) {
+                // the frames held in the partial batch come first: put() could wait
+                // for them to leave the reorder window
+                Batch* pending = batches.flush();
+                if (pending) queue->push(pending);
+                reorder->put({f+1,0,0,0,0,true});
+            }
+            continue;
+        }
         source->read(frame);
         original = new Mat(height,width,CV_8UC3,Scalar(0,0,0));
         memcpy(original->data, frame.data, nbytes); 
-        queue->push(original);
+        Batch* batch = batches.add(new Frame(original,f+1));
+        if (batch) queue->push(batch);
     }
+    Batch* last = batches.flush();
+    if (last) queue->push(last);
     // After read all frame, exit
     queue->end();
     return;
 }
 
+/**
+ * @brief Loader of a raw stream: the frames are read until the end of the stream (or the
+ * first "limit" frames), their number is known only at the end.
+ *
+ * @param stream Raw stream (pipe, FIFO or standard input)
+ * @param width,height shape of frame
+ * @param queue queue to insert the frame read
+ * @param limit maximum number of frames to read (0 = until the end)
+ * @param B number of frames per batch
+ * @param totalf set to the number of frames seen (background included)
+ */
+void stream_loader(RawStream* stream,int width,int height,SQueue* queue,long limit,int B,int* totalf) {
+
+    BatchBuilder batches(B);
+    long f = 0;
+    Mat* original;
+    while(limit == 0 || f < limit) {
+        original = new Mat(height,width,CV_8UC3,Scalar(0,0,0));
+        if (!stream->read(original)) {
+            delete original;
+            break;
+        }
+        f++;
+        Batch* batch = batches.add(new Frame(original,f));
+        if (batch) queue->push(batch);
+    }
+    Batch* last = batches.flush();
+    if (last) queue->push(last);
+    *totalf = f+1;
+    queue->end();
+}
+
+/**
+ * @brief NUMA version of the loader: there is a queue per node and the frames are pushed
+ * in the queue of the loader's node (where they are decoded and allocated). Only when
+ * that node has a backlog bigger than its workers the frame goes to the least loaded node.
+ *
+ * @param source Video capture pointer (read frame)
+ * @param queues one queue per NUMA node
+ * @param topo NUMA topology (it tells also where the loader runs)
+ * @param nw number of workers
+ * @param totalf number of frames to read (background included)
+ * @param B number of frames per batch
+ * @param first first frame to read (the source is positioned on it)
+ */
+void numa_loader_worker(VideoCapture* source,vector<SQueue*>* queues,NumaTopology* topo,int nw,
+                        int totalf,int B,long first = 1) {
+
+    NumaTopology::pin(pthread_self(),topo->loaderCpu());
+
+    int width  = source->get(CAP_PROP_FRAME_WIDTH);
+    int height = source->get(CAP_PROP_FRAME_HEIGHT);
+    int nbytes = sizeof(unsigned char)*width*height*3;
+    int local  = topo->loaderNode();
+
+    Mat frame,*original;
+    BatchBuilder batches(B);
+    for(int f=first-1;f<=totalf-1;f++) {
+
+        Batch* batch;
+        if (f < totalf-1) {
+            source->read(frame);
+            original = new Mat(height,width,CV_8UC3,Scalar(0,0,0));
+            memcpy(original->data, frame.data, nbytes);
+            batch = batches.add(new Frame(original,f+1));
+        } else batch = batches.flush(); // last partial batch
+        if (batch == nullptr) continue;
+
+        int target = local;
+        if ((int)(*queues)[local]->size() >= topo->workersOn(local,nw)) {
+            // the local workers are busy, choose the node with less frames per worker
+            float best = -1;
+            for(int n=0;n<topo->nodes();n++) {
+                int w = topo->workersOn(n,nw);
+                if (w == 0) continue;
+                float load = (float)(*queues)[n]->size() / w;
+                if (best < 0 || load < best) { best = load; target = n; }
+            }
+        }
+        (*queues)[target]->push(batch);
+    }
+    for(auto q : *queues) q->end();
+}
+
 /**
  * @brief This is a node of farm, it process the entire computation
  * 
- * @param source VideoCapture pointer (to retrieve some information)
+ * @param width,height shape of frame
  * @param queue Queue where to get frame
  * @param dx "padding" (x grayscaling)
  * @param k percentage
  * @param background background image for comparisons
+ * @param cpu cpu where the worker is pinned (-1 no pinning)
+ * @param reorder buffer where the per-frame results are put (nullptr if not --ordered)
+ * @param id index of the worker
+ * @param elastic controller that parks the worker (nullptr if not --elastic)
  */
-void complete_worker(VideoCapture* source,SQueue* queue,int dx,float k,Mat* background) {
+void complete_worker(int width,int height,SQueue* queue,int dx,float k,Mat* background,int cpu,
+                     ReorderBuffer* reorder,int id,Elastic* elastic) {
+
+    // Pin before allocating, so the gray buffer is first-touched on the worker's node
+    if (cpu >= 0) NumaTopology::pin(pthread_self(),cpu);
 
-    int width  = source->get(CAP_PROP_FRAME_WIDTH);
-    int height = source->get(CAP_PROP_FRAME_HEIGHT);
     int dim    = (dx+dx+1)*(dx+dx+1); // Kerenl's dimentions
     int pixels = height*width; // Frame's dimentions
 
+    Batch* batch;
     Mat* original;
     Mat* gray = new Mat(height+dx+dx,width+dx+dx,CV_8UC1,DEFAULT_IMG);
 
     int i,j,z,w;     // Counters
     float r,g,b,acc; // red,gree,blue & accomulator
     ulong totald;    // pixels that are different
+    ulong detected;  // frames of the batch "detected"
 
     while(1)  {
 
-        original = queue->get();
+        if (elastic) elastic->park(id);
+        batch = queue->get();
         // if the pointer is null means that the worker can terminate
-        if (original == nullptr) break;
+        if (batch == nullptr) break;
+        auto start = chrono::steady_clock::now();
+
+        // The frames of the batch are processed back to back
+        detected = 0;
+        for(Frame* frame : batch->frames) {
+            original = frame->data;
+            auto t0 = chrono::steady_clock::now();
+
+            // We take each RGB pixel and we tranform it into grayscale pixel
+            for (i = 0; i < height; i++) {
+                for (j = 0; j < width; j++){
+                    r = 0.2989  * original->at<Vec3b>(i, j)[2];
+                    g = 0.5870  * original->at<Vec3b>(i, j)[1];
+                    b = 0.1140  * original->at<Vec3b>(i, j)[0];
+                    gray->at<uchar>(i+dx, j+dx) = round(r+g+b);
+                }
+            }
+            delete original; // we need it no more
+            frame->data = nullptr;
+            auto t1 = chrono::steady_clock::now();
+
+            totald = 0;
+
+            // foreach pixel inside the grayscale image
+            for (i = 0; i < height ; i++) {
+                for (j = 0; j < width ; j++) {
+                    acc = 0;
+                    // we take a average of neighboors of pixel i,j
+                    // oss. we use +dx 'cause of padding explained before
+                    for(z=-dx;z<=dx;z++)for(w=-dx;w<=dx;w++) 
+                            acc += gray->at<uchar>(i+dx+z,j+dx+w);   
+                    // acc means total of neighboors pixel 
+                    totald += background->at<uchar>(i, j) - static_cast<uchar>(acc/dim) != 0;
+                }
+            }
+            // "Differents pixels" are divided by all pixels to obtain a percentage
+            // if perc > k then the frame is "different" from background
+            ushort flag = (((float)totald )/pixels) > k ;
+            detected += flag;
+            if (reorder) reorder->put({frame->idx,totald,flag,stage_us(t0,t1),stage_us(t1,chrono::steady_clock::now())});
+        }
+        delete batch;
+
+        // totalDiff atomic variable! (updated once per batch)
+        totalDiff += detected;
+        if (elastic) elastic->served(chrono::duration_cast<chrono::microseconds>(
+                                        chrono::steady_clock::now() - start).count());
+    }
+    delete gray;
+}
+
+/**
+ * @brief Worker of a memory-mapped input (Y4M/raw yuv): there is no loader, the workers take
+ * the next B frames from a shared counter and read their luma straight from the mapping.
+ * The luma is already the grayscale image, so only the blurring remains: the pixels far
+ * from the borders read the mapping directly, the others use the padding value outside.
+ *
+ * @param yuv Mapped video
+ * @param next Next frame to take
+ * @param totalf Number of frames to analyze (background included)
+ * @param dx "padding"
+ * @param k percentage
+ * @param background background image for comparisons
+ * @param B number of frames taken at once
+ * @param reorder buffer where the per-frame results are put (nullptr if not --ordered)
+ */
+void mapped_worker(YuvFile* yuv,atomic<long>* next,long totalf,int dx,float k,Mat* background,int B,
+                   ReorderBuffer* reorder) {
+
+    int width  = yuv->cols();
+    int height = yuv->rows();
+    int dim    = (dx+dx+1)*(dx+dx+1); // Kerenl's dimentions
+    long pixels = (long)width*height;  // Frame's dimentions
+
+    int i,j,z,w,r,c; // Counters
+    float acc;       // accomulator
+    long first;
+    const uchar* lv = yuv->levels(); // the luma is read in place, its gray level from the table
+
+    while((first = next->fetch_add(B)) < totalf) {
+
+        ulong detected = 0; // frames "detected" among the B taken
+        for(long f=first;f<min(first+B,totalf);f++) {
+            auto t0 = chrono::steady_clock::now();
+            const uchar* y = yuv->frame(f);
+            ulong totald = 0;
+
+            for (i = 0; i < height ; i++) {
+                for (j = 0; j < width ; j++) {
+                    acc = 0;
+                    if (i >= dx && i < height-dx && j >= dx && j < width-dx) {
+                        for(z=-dx;z<=dx;z++) {
+                            const uchar* row = y + (size_t)(i+z)*width + j;
+                            for(w=-dx;w<=dx;w++) acc += lv[row[w]];
+                        }
+                    } else {
+                        for(z=-dx;z<=dx;z++)for(w=-dx;w<=dx;w++) {
+                            r = i+z; c = j+w;
+                            acc += (r < 0 || r >= height || c < 0 || c >= width) ? 128 : lv[y[(size_t)r*width+c]];
+                        }
+                    }
+                    totald += background->at<uchar>(i, j) - static_cast<uchar>(acc/dim) != 0;
+                }
+            }
+            ushort flag = (((float)totald )/pixels) > k ;
+            detected += flag;
+            if (reorder) reorder->put({f,totald,flag,0,stage_us(t0,chrono::steady_clock::now())});
+        }
+        totalDiff += detected;
+    }
+}
 
-        // We take each RGB pixel and we tranform it into grayscale pixel
+/**
+ * @brief Worker of a shared-memory ring (--shm): there is no loader, the workers take the
+ * next frame from a shared counter, process it in place in the ring and release its slot.
+ *
+ * @param ring Ring written by the capture process
+ * @param next Next frame to take
+ * @param limit Frames to analyze, background included (0 = until the producer closes)
+ * @param dx "padding"
+ * @param k percentage
+ * @param background background image for comparisons
+ * @param reorder buffer where the per-frame results are put (nullptr if not --ordered)
+ */
+void shm_worker(ShmRing* ring,atomic<long>* next,long limit,int dx,float k,Mat* background,
+                ReorderBuffer* reorder) {
+
+    int width  = ring->cols();
+    int height = ring->rows();
+    int dim    = (dx+dx+1)*(dx+dx+1); // Kerenl's dimentions
+    long pixels = (long)width*height;  // Frame's dimentions
+    Mat* gray = new Mat(height+dx+dx,width+dx+dx,CV_8UC1,DEFAULT_IMG);
+
+    int i,j,z,w;     // Counters
+    float r,g,b,acc; // red,gree,blue & accomulator
+    long f;
+    const uchar* bgr;
+
+    while((f = next->fetch_add(1)) < limit || limit == 0) {
+        if ((bgr = ring->acquire(f)) == nullptr) break;
+        auto t0 = chrono::steady_clock::now();
         for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++){
-                r = 0.2989  * original->at<Vec3b>(i, j)[2];
-                g = 0.5870  * original->at<Vec3b>(i, j)[1];
-                b = 0.1140  * original->at<Vec3b>(i, j)[0];
+            const uchar* p = bgr + (size_t)i*width*3;
+            for (j = 0; j < width; j++,p += 3) {
+                r = 0.2989  * p[2];
+                g = 0.5870  * p[1];
+                b = 0.1140  * p[0];
                 gray->at<uchar>(i+dx, j+dx) = round(r+g+b);
             }
         }
-        delete original; // we need it no more
+        // the gray image is a copy, the slot goes back to the producer at once
+        ring->release(f);
+        auto t1 = chrono::steady_clock::now();
 
-        totald = 0;
-
-        // foreach pixel inside the grayscale image
+        ulong totald = 0;
         for (i = 0; i < height ; i++) {
             for (j = 0; j < width ; j++) {
                 acc = 0;
-                // we take a average of neighboors of pixel i,j
-                // oss. we use +dx 'cause of padding explained before
-                for(z=-dx;z<=dx;z++)for(w=-dx;w<=dx;w++) 
-                        acc += gray->at<uchar>(i+dx+z,j+dx+w);   
-                // acc means total of neighboors pixel 
+                for(z=-dx;z<=dx;z++)for(w=-dx;w<=dx;w++)
+                        acc += gray->at<uchar>(i+dx+z,j+dx+w);
                 totald += background->at<uchar>(i, j) - static_cast<uchar>(acc/dim) != 0;
             }
         }
-        // "Differents pixels" are divided by all pixels to obtain a percentage
-        // if perc > k then the frame is "different" from background
-        // totalDiff atomic variable!
-        totalDiff +=  (((float)totald )/pixels) > k ;
-
+        ushort flag = (((float)totald )/pixels) > k ;
+        totalDiff += flag;
+        if (reorder) reorder->put({f,totald,flag,stage_us(t0,t1),stage_us(t1,chrono::steady_clock::now())});
     }
     delete gray;
 }
@@ -92,6 +341,7 @@ void complete_worker(VideoCapture* source,SQueue* queue,int dx,float k,Mat* back
 class ThreadFarm {
 
     private:
+    string path;              // Path of the video
     VideoCapture* source;     // Source of video
     int width,height;         // Shape of frame
     int totalf;               // Number of total frame in the video
@@ -99,17 +349,147 @@ class ThreadFarm {
     float k;                  // Percentage
     vector<thread*>* workers; // Farm of complete-workers
     Mat* background;          // Background images used for comparisons
+    Options opt;              // Optional settings
+    NumaTopology* topo;       // NUMA layout (only with --numa)
+    vector<Mat*> backgrounds; // Background replica of each NUMA node
+    ReorderBuffer* reorder;   // Results in frame order (only with --ordered)
+    vector<ResultSink*> sinks; // Consumers of the ordered results
+    Elastic* elastic;         // Parks and wakes the workers (only with --elastic)
+    YuvFile* yuv;             // Memory-mapped input (.y4m/.yuv), the video is not decoded
+    RawStream* stream;        // Raw frames from a pipe (--stream), their number is unknown
+    ShmRing* shm;             // Shared-memory ring of a capture process (--shm)
+    Checkpoint* checkpoint;   // Checkpoint of the job (only with --checkpoint)
+    long first;               // First frame to analyze (after the watermark when resuming)
+    Prefilter* prefilter;     // Static frames of the compressed video (only with --prefilter)
 
     void cleanUp() {
-        source->release();
+        if (source) source->release();
+        delete yuv;
+        delete stream;
+        delete shm;
         delete background;
+        for(auto b : backgrounds) delete b;
+        delete topo;
+        delete reorder;
+        delete elastic;
+        for(auto s : sinks) delete s;
+        delete checkpoint;
+        delete prefilter;
         delete source;
         delete workers;
     }
 
+    // Gives the results in frame order to the sinks
+    void collector() {
+        Result r;
+        while(reorder->get(r))
+            for(auto s : sinks) s->put(r);
+        for(auto s : sinks) s->end();
+    }
+
+    // Start the loader and the workers, then wait until the termination
+    void farm() {
+
+        vector<thread*> loaders;
+        vector<SQueue*> queues;
+        atomic<int> running;
+        thread* ordered = nullptr;
+
+        if (opt.ordered) {
+            // by default the window can hold two batches per worker
+            int window = opt.window > 0 ? opt.window : 2*nw*opt.batch;
+            reorder = new ReorderBuffer(window,first);
+            ordered = new thread(&ThreadFarm::collector,this);
+            NumaTopology::pin(ordered,Affinity::at(opt.pin.collector,0));
+        }
+
+        atomic<long> next(first);
+        if (yuv) {
+            // No loader: the workers take the frames from the mapping
+            for(int i=0;i<nw;i++)
+                (*workers)[i] = new thread(mapped_worker,yuv,&next,totalf,dx,k,background,opt.batch,reorder);
+        } else if (shm) {
+            // No loader: the workers read the frames in the ring
+            for(int i=0;i<nw;i++)
+                (*workers)[i] = new thread(shm_worker,shm,&next,opt.frames > 0 ? opt.frames+1 : 0,dx,k,
+                                           background,reorder);
+        } else if (!opt.numa) {
+            // Create a Shared Queue
+            queues.push_back(new SQueue());
+
+            // Start nw worker that perform the same function
+            for(int i=0;i<nw;i++) 
+                (*workers)[i] = new thread(complete_worker,width,height,queues[0],dx,k,background,-1,reorder,
+                                           i,elastic);
+        } else {
+            // One queue per node, each worker is pinned on its node and uses the local replica
+            for(int n=0;n<topo->nodes();n++) queues.push_back(new SQueue());
+
+            for(int i=0;i<nw;i++) {
+                int node = topo->nodeOf(i);
+                (*workers)[i] = new thread(complete_worker,width,height,queues[node],dx,k,
+                                    backgrounds[node],topo->cpuOf(i),reorder,i,elastic);
+            }
+        }
+
+        if (elastic) {
+            // the tasks sent are the batches pushed into the queues
+            elastic->watch([&queues]{
+                long n = 0;
+                for(auto q : queues) n += q->pushed;
+                return n;
+            });
+            elastic->start();
+        }
+
+        // --pin-workers places the workers through their native handles
+        if (!opt.pin.workers.empty())
+            for(int i=0;i<nw;i++) NumaTopology::pin((*workers)[i],Affinity::at(opt.pin.workers,i));
+
+        if (opt.decoders > 1) 
+            // Each decoder reads its own segment of the video
+            loaders = start_decoders(path,totalf,opt.decoders,opt.batch,&queues,&running,topo);
+        else if (yuv || shm)
+            ; // nothing to decode
+        else if (stream)
+            loaders.push_back(new thread(stream_loader,stream,width,height,queues[0],opt.frames,opt.batch,&totalf));
+        else if (!opt.numa)
+            // Start the loader that pushes into queue the frames 
+            loaders.push_back(new thread(loader_worker,source,queues[0],totalf,opt.batch,first,
+                                         opt.prefiltercheck ? nullptr : prefilter,reorder));
+        else 
+            loaders.push_back(new thread(numa_loader_worker,source,&queues,topo,nw,totalf,opt.batch,first));
+        for(size_t d=0;d<loaders.size();d++) NumaTopology::pin(loaders[d],Affinity::at(opt.pin.decoder,d));
+
+        // Wait until the termination
+        for(auto l : loaders) {
+            l->join();
+            delete l;
+        }
+        // the parked workers must wake up to see the end of the queue
+        if (elastic) elastic->stop();
+
+        // Same for workers
+        for(int i=0;i<nw;i++) {
+            (*workers)[i]->join();
+            delete (*workers)[i];
+        }
+        for(auto q : queues) delete q;
+        // the frames of the ring are known when the producer closes it
+        if (shm) totalf = opt.frames > 0 ? min(shm->published(),(long)opt.frames+1) : shm->published();
+
+        if (ordered) {
+            reorder->close();
+            ordered->join();
+            delete ordered;
+        }
+    }
+
     public:
-    ThreadFarm(const string path,const int ksize,const float k,const int nw):
-        k(k),nw(nw),dx(ksize/2) {
+    ThreadFarm(const string path,const int ksize,const float k,const int nw,const Options opt = Options()):
+        path(path),source(nullptr),dx(ksize/2),nw(nw),k(k),opt(opt),topo(nullptr),reorder(nullptr),
+        elastic(nullptr),yuv(nullptr),stream(nullptr),shm(nullptr),checkpoint(nullptr),first(1),
+        prefilter(nullptr) {
 
         // checking argument
         ERROR_MSG(path == "","path error")
@@ -117,56 +497,115 @@ class ThreadFarm {
         ERROR_MSG(k<= 0 || k>1,"%'of pixel must be between 0 and 1")
         ERROR_MSG(nw<= 0,"Workers must be more than 0")
 
-        this->source = new VideoCapture(path); 
         this->workers = new vector<thread*>(nw);
+        Mat frame,*gray = nullptr;
+
+        if (opt.stream) {
+            ERROR_MSG(opt.decoders > 1 || opt.numa,"--decoders and --numa cannot be used with a stream")
+            this->stream = new RawStream(path,opt.width,opt.height,opt.pixfmt);
+            this->width  = opt.width;
+            this->height = opt.height;
+            this->totalf = 0; // known at the end of the stream
+
+            // The first frame of the stream is the background
+            Mat* first = new Mat(height,width,CV_8UC3,Scalar(0,0,0));
+            ERROR_MSG(!stream->read(first),"Error in read frame operation")
+            gray = VideoDetect::static_toGray(*first,height,width,dx);
+            delete first;
+        } else if (opt.shm) {
+            ERROR_MSG(opt.decoders > 1 || opt.numa || opt.elastic > 0,
+                      "--decoders, --numa and --elastic cannot be used with a shared-memory ring")
+            this->shm = new ShmRing(path);
+            this->width  = shm->cols();
+            this->height = shm->rows();
+            this->totalf = 0; // known when the producer closes the ring
+
+            // The first frame of the ring is the background
+            const uchar* first = shm->acquire(0);
+            ERROR_MSG(first == nullptr,"Error in read frame operation")
+            gray = VideoDetect::static_toGray(Mat(height,width,CV_8UC3,(void*)first),height,width,dx);
+            shm->release(0);
+        } else if (YuvFile::accepts(path)) {
+            ERROR_MSG(opt.decoders > 1 || opt.numa || opt.elastic > 0 || opt.prefilter,
+                      "--decoders, --numa, --elastic and --prefilter cannot be used with a mapped video")
+            this->yuv = new YuvFile(path,opt.width,opt.height);
+            this->width  = yuv->cols();
+            this->height = yuv->rows();
+            this->totalf = opt.frames > 0 ? min(yuv->frames(),(long)opt.frames+1) : yuv->frames();
+            ERROR_MSG(totalf<3,"Too short video")
+
+            this->checkpoint = Checkpoint::open(opt,path,ksize,k,width,height);
+            if (checkpoint && checkpoint->resuming()) this->background = checkpoint->restore(nullptr);
+            else {
+                // The luma of the first frame is the grayscale background
+                gray = new Mat(height+dx+dx,width+dx+dx,CV_8UC1,DEFAULT_IMG);
+                yuv->toGray(0,gray,dx);
+            }
+        } else {
+            this->source = open_video(path); 
 
-        // Check if the video is opened
-        ERROR_MSG(!source->isOpened(),"Error opening video")
+            // Check if the video is opened
+            ERROR_MSG(!source->isOpened(),"Error opening video")
 
-        this->width  = source->get(CAP_PROP_FRAME_WIDTH);
-        this->height = source->get(CAP_PROP_FRAME_HEIGHT);
-        this->totalf = source->get(CAP_PROP_FRAME_COUNT);
+            this->width  = source->get(CAP_PROP_FRAME_WIDTH);
+            this->height = source->get(CAP_PROP_FRAME_HEIGHT);
+            this->totalf = frame_count(*source,opt);
 
-        // We need at least 2 frame: one is the background, the other is the frame to compare
-        ERROR_MSG(totalf<3,"Too short video")
+            // We need at least 2 frame: one is the background, the other is the frame to compare
+            ERROR_MSG(totalf<3,"Too short video")
 
-        // ---- First of all we retrieve the background ----
+            if (opt.prefilter) this->prefilter = new Prefilter(path,totalf,opt.prefilterbytes,opt.prefiltermvs);
 
-        Mat frame,*gray;
-        // take the fist frame of the video
-        ERROR_MSG(!source->read(frame),"Error in read frame operation")
+            // A resumed job finds the background in the checkpoint
+            this->checkpoint = Checkpoint::open(opt,path,ksize,k,width,height);
+            if (checkpoint && checkpoint->resuming()) this->background = checkpoint->restore(source);
+            else {
+                // ---- First of all we retrieve the background ----
 
-        // Tranform the RGB image into gray scale
-        gray = VideoDetect::static_toGray(frame,height,width,dx);
+                // take the fist frame of the video
+                ERROR_MSG(!source->read(frame),"Error in read frame operation")
 
-        // Apply the convolution (blurring)
-        this->background = VideoDetect::static_convolve(gray,height,width,dx);
-        
-        delete gray;
+                // Tranform the RGB image into gray scale
+                gray = VideoDetect::static_toGray(frame,height,width,dx);
+            }
+        }
+
+        if (gray) {
+            // Apply the convolution (blurring)
+            this->background = VideoDetect::static_convolve(gray,height,width,dx);
+            delete gray;
+        }
+        if (checkpoint) {
+            // the watermark follows the ordered results, the counters go on from the checkpoint
+            checkpoint->keep(background);
+            this->first = checkpoint->first();
+            totalDiff = checkpoint->detected();
+        }
+
+        if (opt.numa) {
+            this->topo = new NumaTopology(opt.decoders,nw);
+            this->backgrounds = topo->replicate(background);
+        }
+        this->sinks = make_sinks(opt,(long)width*height,checkpoint ? checkpoint->watermark() : 0);
+        if (checkpoint) sinks.push_back(new CheckpointSink(checkpoint,sinks));
+        if (prefilter && opt.prefiltercheck) sinks.push_back(new PrefilterSink(prefilter));
+        // with --numa one worker per node stays active
+        if (opt.elastic > 0) this->elastic = new Elastic(nw,opt.elastic,opt.numa ? topo->nodes() : 1);
     }
     
     void execute_to_result() {
 
-        // Create a Shared Queue
-        SQueue* q = new SQueue();
-
-        // Start the loader that pushes into queue the frames 
-        thread* loader = new thread(loader_worker,source,q);
-
-        // Start nw worker that perform the same function
-        for(int i=0;i<nw;i++) 
-            (*workers)[i] = new thread(complete_worker,source,q,dx,k,background);
+        farm();
 
-        // Wait until the termination
-        loader->join();
-
-        // Same for workers
-        for(int i=0;i<nw;i++) {
-            (*workers)[i]->join();
-            delete (*workers)[i];
-        }
         cout << "Total frame: " << totalf << endl;
         cout << "Total diff: " << totalDiff << endl;
+        if (reorder) cout << "Reorder stalls: " << reorder->stalls() << endl;
+        if (checkpoint) cout << "Checkpoints: " << checkpoint->count() << " (" << checkpoint->time() << " us)" << endl;
+        if (prefilter) prefilter->report(totalf);
+        if (elastic) {
+            cout << "Mean active workers: " << elastic->meanActive() << endl;
+            if (opt.trace != "") elastic->dump(opt.trace);
+        }
         cleanUp();
         exit(0);
 
@@ -174,21 +613,10 @@ class ThreadFarm {
     void execute_to_stat() {
         // As before but in this case the measure the time execution
         
-        SQueue* q = new SQueue();
         long elapsed;
         {   
             utimer u("",&elapsed);
-            for(int i=0;i<nw;i++) {
-                (*workers)[i] = new thread(complete_worker,source,q,dx,k,background);
-            }
-
-            thread* loader = new thread(loader_worker,source,q);
-            loader->join();
-
-            for(int i=0;i<nw;i++) {
-                (*workers)[i]->join();
-                delete (*workers)[i];
-            }
+            farm();
         }
         cout << elapsed << endl;
 
@@ -0,0 +1,274 @@
+// Ring between two threads of consecutive stages
+typedef SpscRing<Frame*> FrameRing;
+
+// Fifth implementation
+class ThreadPipeline {
+
+    private:
+    string path;              // Path of the video
+    VideoCapture* source;     // Source of video
+    int width,height;         // Shape of frame
+    int totalf;               // Number of total frame in the video
+    int dx,dim;               // "padding" and kernel's dimentions
+    long pixels;              // Frame's dimentions
+    float k;                  // Percentage
+    int nd,ng,nb;             // Threads of the decode, gray and blur stages
+    Mat* background;          // Background images used for comparisons
+    Options opt;              // Optional settings
+
+    // toGray[d][g] carries the frames from decoder d to gray thread g, toBlur[g][b] the
+    // grayscaled frames from gray thread g to blur thread b
+    vector<vector<FrameRing*>> toGray,toBlur;
+    atomic<ulong> totalDiff;  // Frames "detected"
+    vector<ulong> busy[3];    // Time (us) spent working by each thread of each stage
+
+    static const size_t RING = 4; // Frames per ring
+
+    void cleanUp() {
+        source->release();
+        delete background;
+        delete source;
+    }
+
+    static long since(chrono::steady_clock::time_point start) {
+        return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+    }
+
+    // Rings that arrive to the c-th thread of the next stage
+    static vector<FrameRing*> column(vector<vector<FrameRing*>>& rings,int c) {
+        vector<FrameRing*> in;
+        for(auto& row : rings) in.push_back(row[c]);
+        return in;
+    }
+
+    // Give the frame to the first consumer (round robin) that has space
+    static void send(vector<FrameRing*>& out,size_t& next,Frame* f) {
+        Backoff backoff;
+        while(1) {
+            for(size_t i=0;i<out.size();i++) {
+                size_t c = (next+i) % out.size();
+                if (out[c]->push(f)) {
+                    next = c+1;
+                    return;
+                }
+            }
+            backoff.wait();
+        }
+    }
+
+    // Tell every consumer that this producer has finished
+    static void end(vector<FrameRing*>& out) {
+        Backoff backoff;
+        for(auto r : out)
+            while(!r->push(nullptr)) backoff.wait();
+    }
+
+    // Take a frame from the producers, nullptr when all of them have finished
+    static Frame* receive(vector<FrameRing*>& in,size_t& next,int& open) {
+        Frame* f;
+        Backoff backoff;
+        while(open > 0) {
+            bool got = false;
+            for(size_t i=0;i<in.size() && !got;i++) {
+                size_t p = (next+i) % in.size();
+                if (!in[p]->pop(f)) continue;
+                next = p+1;
+                if (f != nullptr) return f;
+                open--; // the end of a producer (its ring is empty from now on)
+                got = true;
+            }
+            if (!got) backoff.wait();
+            else backoff.reset();
+        }
+        return nullptr;
+    }
+
+    // Decoder d reads its segment of the video, the first one uses the opened source
+    void decode(int d) {
+        vector<long> bounds = segments(totalf,nd);
+        VideoCapture* src = d == 0 ? source : open_at(path,bounds[d]);
+        int nbytes = sizeof(unsigned char)*width*height*3;
+        size_t next = 0;
+        Mat frame,*original;
+
+        for(long f=bounds[d];f<bounds[d+1];f++) {
+            auto start = chrono::steady_clock::now();
+            ERROR_MSG(!src->read(frame),"Error in read frame operation")
+            original = new Mat(height,width,CV_8UC3,Scalar(0,0,0));
+            memcpy(original->data, frame.data, nbytes);
+            busy[0][d] += since(start);
+            send(toGray[d],next,new Frame(original,f));
+        }
+        end(toGray[d]);
+        if (d != 0) {
+            src->release();
+            delete src;
+        }
+    }
+
+    // The frame given to the blur stage carries the (padded) grayscale image
+    void gray(int g) {
+        vector<FrameRing*> in = column(toGray,g);
+        size_t from = 0,next = 0;
+        int open = nd;
+        Frame* frame;
+        float r,gr,b;
+
+        while((frame = receive(in,from,open)) != nullptr) {
+            auto start = chrono::steady_clock::now();
+            Mat* original = frame->data;
+            Mat* gray = new Mat(height+dx+dx,width+dx+dx,CV_8UC1,DEFAULT_IMG);
+            for (int i = 0; i < height; i++) {
+                for (int j = 0; j < width; j++){
+                    r  = 0.2989  * original->at<Vec3b>(i, j)[2];
+                    gr = 0.5870  * original->at<Vec3b>(i, j)[1];
+                    b  = 0.1140  * original->at<Vec3b>(i, j)[0];
+                    gray->at<uchar>(i+dx, j+dx) = round(r+gr+b);
+                }
+            }
+            delete original;
+            frame->data = gray;
+            busy[1][g] += since(start);
+            send(toBlur[g],next,frame);
+        }
+        end(toBlur[g]);
+    }
+
+    void blur(int t) {
+        vector<FrameRing*> in = column(toBlur,t);
+        size_t from = 0;
+        int open = ng;
+        Frame* frame;
+        float acc;
+
+        while((frame = receive(in,from,open)) != nullptr) {
+            auto start = chrono::steady_clock::now();
+            Mat* gray = frame->data;
+            ulong totald = 0;
+            for (int i = 0; i < height ; i++) {
+                for (int j = 0; j < width ; j++) {
+                    acc = 0;
+                    for(int z=-dx;z<=dx;z++)for(int w=-dx;w<=dx;w++)
+                            acc += gray->at<uchar>(i+dx+z,j+dx+w);
+                    totald += background->at<uchar>(i, j) - static_cast<uchar>(acc/dim) != 0;
+                }
+            }
+            // "Differents pixels" are divided by all pixels to obtain a percentage
+            // if perc > k then the frame is "different" from background
+            totalDiff += (((float)totald)/pixels) > k;
+            delete frame;
+            busy[2][t] += since(start);
+        }
+    }
+
+    void run() {
+        toGray.assign(nd,vector<FrameRing*>(ng));
+        toBlur.assign(ng,vector<FrameRing*>(nb));
+        for(auto& row : toGray) for(auto& r : row) r = new FrameRing(RING);
+        for(auto& row : toBlur) for(auto& r : row) r = new FrameRing(RING);
+
+        // the blur threads are the workers, the gray threads take the --pin-map cores
+        vector<thread*> threads;
+        for(int i=0;i<nb;i++) {
+            threads.push_back(new thread(&ThreadPipeline::blur,this,i));
+            NumaTopology::pin(threads.back(),Affinity::at(opt.pin.workers,i));
+        }
+        for(int i=0;i<ng;i++) {
+            threads.push_back(new thread(&ThreadPipeline::gray,this,i));
+            NumaTopology::pin(threads.back(),Affinity::at(opt.pin.map,i));
+        }
+        for(int i=0;i<nd;i++) {
+            threads.push_back(new thread(&ThreadPipeline::decode,this,i));
+            NumaTopology::pin(threads.back(),Affinity::at(opt.pin.decoder,i));
+        }
+        for(auto t : threads) {
+            t->join();
+            delete t;
+        }
+
+        for(auto& row : toGray) for(auto r : row) delete r;
+        for(auto& row : toBlur) for(auto r : row) delete r;
+    }
+
+    public:
+    /**
+     * @brief Pipeline of three stages of std::threads (decode, gray, blur and detect) with
+     * independent widths. Every pair of threads of consecutive stages is connected by its
+     * own single-producer/single-consumer lock-free ring.
+     *
+     * @param path Path of video to analyze
+     * @param ksize Number of pixel per side (kernel = matrix of ksize*ksize)
+     * @param k % of pixels that must be different to trigger "detection"
+     * @param nb Threads of the blur stage
+     * @param opt Optional settings: threads of the decode (--decoders) and gray (--gray) stages,
+     * cores of the decode, gray and blur threads (--pin-decoder, --pin-map, --pin-workers)
+     */
+    ThreadPipeline(const string path,const int ksize,const float k,const int nb,const Options opt = Options()):
+        path(path),dx(ksize/2),dim(ksize*ksize),k(k),nd(opt.decoders),ng(opt.gray),nb(nb),
+        opt(opt),totalDiff(0) {
+
+        // checking argument
+        ERROR_MSG(path == "","path error")
+        ERROR_MSG(ksize < 3 || ksize%2==0,"kernel size must be >3 and odd")
+        ERROR_MSG(k<= 0 || k>1,"%'of pixel must be between 0 and 1")
+        ERROR_MSG(nb<= 0,"Workers must be more than 0")
+        ERROR_MSG(ng<= 0,"Gray workers must be more than 0")
+
+        this->source = open_video(path);
+
+        // Check if the video is opened
+        ERROR_MSG(!source->isOpened(),"Error opening video")
+
+        this->width  = source->get(CAP_PROP_FRAME_WIDTH);
+        this->height = source->get(CAP_PROP_FRAME_HEIGHT);
+        this->totalf = frame_count(*source,opt);
+        this->pixels = width*height;
+
+        // We need at least 2 frame: one is the background, the other is the frame to compare
+        ERROR_MSG(totalf<3,"Too short video")
+
+        busy[0].assign(nd,0);
+        busy[1].assign(ng,0);
+        busy[2].assign(nb,0);
+
+        // ---- First of all we retrieve the background ----
+
+        Mat frame,*gray;
+        ERROR_MSG(!source->read(frame),"Error in read frame operation")
+        gray = VideoDetect::static_toGray(frame,height,width,dx);
+        this->background = VideoDetect::static_convolve(gray,height,width,dx);
+        delete gray;
+    }
+
+    void execute_to_result() {
+        run();
+        cout << "Total frame: " << totalf << endl;
+        cout << "Total diff: " << totalDiff << endl;
+        cleanUp();
+        exit(0);
+    }
+
+    void execute_to_stat() {
+        long elapsed;
+        {
+            utimer u("",&elapsed);
+            run();
+        }
+        cout << elapsed << endl;
+        cleanUp();
+        exit(0);
+    }
+
+    // Mean busy time (us) of a thread of each stage: decode, gray, blur. The stages are
+    // balanced when the three values are close
+    void execute_to_stat2() {
+        run();
+        for(int s=0;s<3;s++) {
+            ulong sum = 0;
+            for(auto b : busy[s]) sum += b;
+            cout << sum/busy[s].size() << (s < 2 ? "," : "\n");
+        }
+        cleanUp();
+        exit(0);
+    }
+};
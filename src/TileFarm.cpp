@@ -0,0 +1,284 @@
+/**
+ * @brief Frame being processed by the tile workers, the last tile that finishes closes it
+ */
+struct TileJob {
+    Frame* frame;                   // Frame to process
+    atomic<int> remaining;          // Tiles not yet completed
+    atomic<ulong> totald;           // Pixels that are different (sum of the tiles)
+    chrono::steady_clock::time_point start; // When the tiles were released to the workers
+
+    TileJob(Frame* frame,int tiles): frame(frame),remaining(tiles),totald(0) { }
+    ~TileJob() { delete frame; }
+};
+
+/**
+ * @brief Row band [r0,r1) of a frame
+ */
+struct Tile {
+    TileJob* job;
+    int r0,r1;
+};
+
+/**
+ * @brief Work-stealing deque of tiles owned by a worker (guarded by a lock, a deque holds
+ * only the few tiles of one frame). The owner takes the newest tile (back), the thieves
+ * the oldest one (front), so owner and thieves work at the two ends of the deque.
+ */
+class TileDeque {
+    private:
+        deque<Tile> tiles;
+        mutex mtx;
+    public:
+        void push(Tile t) {
+            lock_guard<mutex> l(mtx);
+            tiles.push_back(t);
+        }
+        // Taken by the owner
+        bool pop(Tile& t) {
+            lock_guard<mutex> l(mtx);
+            if (tiles.empty()) return false;
+            t = tiles.back();
+            tiles.pop_back();
+            return true;
+        }
+        // Taken by a thief
+        bool steal(Tile& t) {
+            lock_guard<mutex> l(mtx);
+            if (tiles.empty()) return false;
+            t = tiles.front();
+            tiles.pop_front();
+            return true;
+        }
+};
+
+// Fourth implementation
+class TileFarm {
+
+    private:
+    VideoCapture* source;     // Source of video
+    int width,height;         // Shape of frame
+    int totalf;               // Number of total frame in the video
+    int dx,dim,nw;            // "padding", kernel's dimentions and number of workers
+    long pixels;              // Frame's dimentions
+    float k;                  // Percentage
+    int ntiles;               // Tiles per frame
+    Mat* background;          // Background images used for comparisons
+
+    vector<TileDeque*> deques; // One deque per worker
+    atomic<int> queued;        // Tiles waiting in the deques
+    atomic<bool> finished;     // The loader has released all the frames
+    mutex mtx;                 // Used by the idle workers and by the loader to sleep
+    condition_variable work,taken;
+
+    atomic<ulong> totalDiff;   // Frames "detected"
+    atomic<ulong> latSum,latMax; // Per-frame latency (us)
+    Options opt;               // Optional settings (tiles, pinning, frames)
+
+    void cleanUp() {
+        source->release();
+        delete background;
+        delete source;
+        for(auto d : deques) delete d;
+    }
+
+    // Take the newest tile of our deque, or steal the oldest one of the others
+    bool next(int id,Tile& t) {
+        for(int i=0;i<nw;i++)
+            if (i == 0 ? deques[id]->pop(t) : deques[(id+i)%nw]->steal(t)) {
+                if (--queued == 0) {
+                    // all the tiles were taken: the loader can release the next frame
+                    { lock_guard<mutex> l(mtx); }
+                    taken.notify_one();
+                }
+                return true;
+            }
+        return false;
+    }
+
+    // Gray conversion of the rows [r0-dx,r1+dx) (halo included) and blurring of [r0,r1)
+    void process(Tile t,Mat* band) {
+
+        Mat* original = t.job->frame->data;
+        int i,j,z,w,row;
+        float r,g,b,acc;
+        ulong totald = 0;
+
+        for (i = t.r0-dx; i < t.r1+dx; i++) {
+            row = i-t.r0+dx;
+            // outside the frame the padding value is used
+            if (i < 0 || i >= height) {
+                for (j = 0; j < width; j++) band->at<uchar>(row, j+dx) = 128;
+                continue;
+            }
+            for (j = 0; j < width; j++){
+                r = 0.2989  * original->at<Vec3b>(i, j)[2];
+                g = 0.5870  * original->at<Vec3b>(i, j)[1];
+                b = 0.1140  * original->at<Vec3b>(i, j)[0];
+                band->at<uchar>(row, j+dx) = round(r+g+b);
+            }
+        }
+
+        for (i = t.r0; i < t.r1 ; i++) {
+            row = i-t.r0+dx;
+            for (j = 0; j < width ; j++) {
+                acc = 0;
+                for(z=-dx;z<=dx;z++)for(w=-dx;w<=dx;w++)
+                        acc += band->at<uchar>(row+z,j+dx+w);
+                totald += background->at<uchar>(i, j) - static_cast<uchar>(acc/dim) != 0;
+            }
+        }
+
+        TileJob* job = t.job;
+        job->totald += totald;
+        if (--job->remaining == 0) {
+            // Last tile of the frame
+            totalDiff += (((float)job->totald)/pixels) > k;
+
+            ulong lat = chrono::duration_cast<chrono::microseconds>(
+                            chrono::steady_clock::now() - job->start).count();
+            latSum += lat;
+            ulong max = latMax;
+            while(lat > max && !latMax.compare_exchange_weak(max,lat));
+            delete job;
+        }
+    }
+
+    void worker(int id) {
+        int rows = (height+ntiles-1)/ntiles;
+        // Band with halo, reused by all the tiles of this worker
+        Mat* band = new Mat(rows+dx+dx,width+dx+dx,CV_8UC1,DEFAULT_IMG);
+        Tile t;
+        while(1) {
+            if (next(id,t)) { process(t,band); continue; }
+
+            unique_lock<mutex> l(mtx);
+            work.wait(l,[&]{ return queued > 0 || finished; });
+            if (queued == 0 && finished) break;
+        }
+        delete band;
+    }
+
+    void loader() {
+        int nbytes = sizeof(unsigned char)*width*height*3;
+        int rows = (height+ntiles-1)/ntiles;
+        Mat frame,*original;
+
+        for(int f=0;f<totalf-1;f++) {
+
+            // Decode the next frame while the workers complete the current one
+            ERROR_MSG(!source->read(frame),"Error in read frame operation")
+            original = new Mat(height,width,CV_8UC3,Scalar(0,0,0));
+            memcpy(original->data, frame.data, nbytes);
+            TileJob* job = new TileJob(new Frame(original,f+1),(height+rows-1)/rows);
+
+            // The tiles of the next frame are released only when all the tiles of the
+            // current one were taken, so idle workers steal from the frame in progress
+            {
+                unique_lock<mutex> l(mtx);
+                taken.wait(l,[&]{ return queued == 0; });
+            }
+            job->start = chrono::steady_clock::now();
+            // counted before they are pushed: a worker can take (and uncount) a tile at once
+            int n = (height+rows-1)/rows;
+            queued += n;
+            for(int t=0;t<n;t++)
+                deques[t%nw]->push({job,t*rows,min((t+1)*rows,height)});
+            { lock_guard<mutex> l(mtx); }
+            work.notify_all();
+        }
+        finished = true;
+        { lock_guard<mutex> l(mtx); }
+        work.notify_all();
+    }
+
+    void run() {
+        vector<thread*> workers(nw);
+        for(int i=0;i<nw;i++) {
+            workers[i] = new thread(&TileFarm::worker,this,i);
+            NumaTopology::pin(workers[i],Affinity::at(opt.pin.workers,i));
+        }
+        // the loader runs in the calling thread
+        if (!opt.pin.decoder.empty()) NumaTopology::pin(pthread_self(),Affinity::at(opt.pin.decoder,0));
+        loader();
+        for(int i=0;i<nw;i++) {
+            workers[i]->join();
+            delete workers[i];
+        }
+    }
+
+    public:
+    /**
+     * @brief Low-latency version: each frame is cut in row bands (tiles) that are spread
+     * over per-worker deques, idle workers steal tiles so a frame is processed by all the
+     * cores at the same time.
+     *
+     * @param path Path of video to analyze
+     * @param ksize Number of pixel per side (kernel = matrix of ksize*ksize)
+     * @param k % of pixels that must be different to trigger "detection"
+     * @param nw Number of workers
+     * @param opt Optional settings: tiles per frame (0 = two per worker), cores of the
+     * loader (decoder role) and of the workers, frames
+     */
+    TileFarm(const string path,const int ksize,const float k,const int nw,const Options opt = Options()):
+        dx(ksize/2),dim(ksize*ksize),nw(nw),k(k),queued(0),finished(false),
+        totalDiff(0),latSum(0),latMax(0),opt(opt) {
+
+        // checking argument
+        ERROR_MSG(path == "","path error")
+        ERROR_MSG(ksize < 3 || ksize%2==0,"kernel size must be >3 and odd")
+        ERROR_MSG(k<= 0 || k>1,"%'of pixel must be between 0 and 1")
+        ERROR_MSG(nw<= 0,"Workers must be more than 0")
+        ERROR_MSG(opt.tiles< 0,"Tiles must be more than 0")
+
+        this->source = open_video(path);
+
+        // Check if the video is opened
+        ERROR_MSG(!source->isOpened(),"Error opening video")
+
+        this->width  = source->get(CAP_PROP_FRAME_WIDTH);
+        this->height = source->get(CAP_PROP_FRAME_HEIGHT);
+        this->totalf = frame_count(*source,opt);
+        this->pixels = width*height;
+        this->ntiles = min(opt.tiles > 0 ? opt.tiles : 2*nw,height);
+
+        // We need at least 2 frame: one is the background, the other is the frame to compare
+        ERROR_MSG(totalf<3,"Too short video")
+
+        for(int i=0;i<nw;i++) deques.push_back(new TileDeque());
+
+        // ---- First of all we retrieve the background ----
+
+        Mat frame,*gray;
+        ERROR_MSG(!source->read(frame),"Error in read frame operation")
+        gray = VideoDetect::static_toGray(frame,height,width,dx);
+        this->background = VideoDetect::static_convolve(gray,height,width,dx);
+        delete gray;
+    }
+
+    void execute_to_result() {
+        run();
+        cout << "Total frame: " << totalf << endl;
+        cout << "Total diff: " << totalDiff << endl;
+        cleanUp();
+        exit(0);
+    }
+
+    void execute_to_stat() {
+        long elapsed;
+        {
+            utimer u("",&elapsed);
+            run();
+        }
+        cout << elapsed << endl;
+        cleanUp();
+        exit(0);
+    }
+
+    // Mean and max latency of a frame (us)
+    void execute_to_stat2() {
+        run();
+        cout << latSum/(totalf-1) << "," << latMax << endl;
+        cleanUp();
+        exit(0);
+    }
+};
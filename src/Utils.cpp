@@ -1,4 +1,54 @@
 
+/**
+ * @brief A frame read from the video together with its index (position in the video),
+ * the frame owns the image.
+ */
+struct Frame {
+    Mat* data; // RGB image
+    long idx;  // Index of the frame in the video (0 is the background)
+
+    Frame(Mat* data,long idx): data(data),idx(idx) { }
+    ~Frame() { delete data; }
+};
+
+/**
+ * @brief Group of consecutive frames sent to the workers as a single task (--batch),
+ * in this way the synchronisation cost is paid once per batch. The batch owns its frames.
+ */
+struct Batch {
+    vector<Frame*> frames;
+
+    ~Batch() { for(auto f : frames) delete f; }
+};
+
+/**
+ * @brief Collects consecutive frames into batches of (at most) B frames
+ */
+class BatchBuilder {
+    private:
+        size_t B;       // Frames per batch
+        Batch* current; // Batch being filled
+    public:
+        BatchBuilder(size_t B): B(B),current(new Batch()) { }
+        ~BatchBuilder() { delete current; }
+
+        // Add a frame, returns the batch when it is full (nullptr otherwise)
+        Batch* add(Frame* f) {
+            current->frames.push_back(f);
+            if (current->frames.size() < B) return nullptr;
+            Batch* full = current;
+            current = new Batch();
+            return full;
+        }
+        // Returns the last (partial) batch, nullptr if there are no frames left
+        Batch* flush() {
+            if (current->frames.empty()) return nullptr;
+            Batch* last = current;
+            current = new Batch();
+            return last;
+        }
+};
+
 /**
  * @brief The shared queue is used to hide a lock and mutex mechanism and to provide 
  * a mutal-exclusion queue.
@@ -7,32 +57,92 @@
 class SQueue {
     
     private:
-        queue<Mat*> frameQ; // Queue of frames
+        queue<Batch*> frameQ; // Queue of frames
         mutex mtx; // Mutex
         condition_variable c; 
     public:
         atomic<bool> finished; // True if all frame are red
+        atomic<long> pushed;   // Batches pushed since the start
 
-        SQueue(): finished(false) { }
+        SQueue(): finished(false),pushed(0) { }
 
         void end() { finished = true; c.notify_all(); }
 
         // Load a new frame in queue
-        void push(Mat* v) { 
+        void push(Batch* v) { 
             unique_lock<mutex> l(mtx);
             frameQ.push(v);
+            pushed++;
             c.notify_one();
         }
         // Retrieve a frame
-        Mat* get()  {
+        Batch* get()  {
             unique_lock<mutex> l(mtx);
             c.wait(l,[&]{return !frameQ.empty() || finished.load();});
         
             if(!frameQ.empty()) {
-                Mat* ret = frameQ.front();
+                Batch* ret = frameQ.front();
                 frameQ.pop();
                 return ret;
             }
             return nullptr; // fro indicate that there are no other frame
         }
+        // Number of frames waiting in the queue
+        size_t size() {
+            unique_lock<mutex> l(mtx);
+            return frameQ.size();
+        }
 }; 
+
+/**
+ * @brief Lock-free ring with a single producer and a single consumer. The producer only
+ * writes tail and the consumer only writes head, so push and pop never wait each other:
+ * they fail when the ring is full (push) or empty (pop) and the caller decides what to do.
+ */
+template <typename T>
+class SpscRing {
+    private:
+        vector<T> slots;
+        size_t mask;                    // Capacity-1 (the capacity is a power of 2)
+        alignas(64) atomic<size_t> head; // Next slot to read (consumer)
+        alignas(64) atomic<size_t> tail; // Next slot to write (producer)
+    public:
+        SpscRing(size_t capacity): head(0),tail(0) {
+            size_t c = 1;
+            while(c < capacity) c <<= 1;
+            slots.resize(c);
+            mask = c-1;
+        }
+
+        bool push(T v) {
+            size_t t = tail.load(memory_order_relaxed);
+            if (t - head.load(memory_order_acquire) == slots.size()) return false;
+            slots[t & mask] = v;
+            tail.store(t+1,memory_order_release);
+            return true;
+        }
+
+        bool pop(T& v) {
+            size_t h = head.load(memory_order_relaxed);
+            if (h == tail.load(memory_order_acquire)) return false;
+            v = slots[h & mask];
+            head.store(h+1,memory_order_release);
+            return true;
+        }
+};
+
+/**
+ * @brief Wait of a thread polling lock-free rings: the first attempts only yield, then the
+ * thread sleeps longer and longer (up to 500 us), so a stage that waits does not burn a core
+ */
+class Backoff {
+    private:
+        int attempts = 0;
+    public:
+        void wait() {
+            if (++attempts <= 64) { this_thread::yield(); return; }
+            this_thread::sleep_for(chrono::microseconds(min(1 << min(attempts-64,9),500)));
+        }
+        // The ring moved: the next wait starts yielding again
+        void reset() { attempts = 0; }
+};
@@ -0,0 +1,120 @@
+/**
+ * @brief Uncompressed video (Y4M, or raw yuv420p with the size given by --size) mapped in
+ * memory. The frames are not decoded nor copied: the luma plane of any frame is read
+ * straight from the mapping, so any number of workers can process any frames in parallel.
+ *
+ * The luma (Y) is used as grayscale image: it is the weighted sum of R,G,B of the grayscale
+ * conversion (BT.601: 0.299, 0.587, 0.114), but usually in limited range (16-235). The luma
+ * goes through a table that stretches it to full range (0-255), as the gray of the RGB
+ * engines; a Y4M file tagged XCOLORRANGE=FULL is used as it is.
+ */
+class YuvFile {
+    private:
+        int fd;              // File descriptor of the video
+        uchar* map;          // Mapping of the whole file
+        size_t length;       // Bytes of the file
+        int width,height;    // Shape of frame
+        vector<size_t> luma; // Offset of the luma plane of each frame
+        bool full;           // The luma is in full range (0-255)
+        uchar level[256];    // Gray level of each luma value
+
+        // Bytes of the chroma planes for a Y4M colour space (C tag)
+        size_t chroma(const string cs) const {
+            size_t cw = (width+1)/2,ch = (height+1)/2;
+            if (cs.rfind("mono",0) == 0) return 0;
+            if (cs.rfind("444",0) == 0) return 2*(size_t)width*height;
+            if (cs.rfind("422",0) == 0) return 2*cw*height;
+            return 2*cw*ch; // 420, 420jpeg, 420paldv, 420mpeg2
+        }
+
+        // The frames of a Y4M file: "FRAME[ params]\n" followed by the planes
+        void indexY4M() {
+            const char* text = (const char*)map;
+            const char* eol = (const char*)memchr(text,'\n',length);
+            ERROR_MSG(eol == nullptr,"Wrong Y4M header")
+
+            string cs = "420";
+            stringstream header(string(text,eol-text));
+            string tag;
+            header >> tag; // YUV4MPEG2
+            while(header >> tag) {
+                if (tag[0] == 'W') width  = stoi(tag.substr(1));
+                if (tag[0] == 'H') height = stoi(tag.substr(1));
+                if (tag[0] == 'C') cs = tag.substr(1);
+                if (tag == "XCOLORRANGE=FULL") full = true;
+            }
+            ERROR_MSG(width <= 0 || height <= 0,"Wrong Y4M header")
+
+            size_t planes = (size_t)width*height + chroma(cs);
+            size_t pos = eol-text+1;
+            while(pos+5 <= length && memcmp(map+pos,"FRAME",5) == 0) {
+                const uchar* nl = (const uchar*)memchr(map+pos,'\n',length-pos);
+                if (nl == nullptr || (size_t)(nl-map)+1+planes > length) break; // truncated
+                luma.push_back(nl-map+1);
+                pos = nl-map+1+planes;
+            }
+        }
+
+        // The frames of a raw yuv420p file are contiguous
+        void indexRaw() {
+            ERROR_MSG(width <= 0 || height <= 0,"Raw yuv needs --size=WxH")
+            size_t planes = (size_t)width*height + chroma("420");
+            for(size_t pos=0;pos+planes<=length;pos+=planes) luma.push_back(pos);
+        }
+
+    public:
+        /**
+         * @param path Path of the video (.y4m or .yuv)
+         * @param width,height Shape of frame of a raw file (a Y4M file has them in the header)
+         */
+        YuvFile(const string path,int width = 0,int height = 0): width(width),height(height),full(false) {
+            fd = open(path.c_str(),O_RDONLY);
+            ERROR_MSG(fd < 0,"Error opening video")
+            struct stat st;
+            ERROR_MSG(fstat(fd,&st) != 0,"Error opening video")
+            length = st.st_size;
+            map = (uchar*)mmap(nullptr,length,PROT_READ,MAP_SHARED,fd,0);
+            ERROR_MSG(map == MAP_FAILED,"Error mapping video")
+            // the frames are taken in (nearly) increasing order
+            madvise(map,length,MADV_SEQUENTIAL);
+
+            if (length >= 9 && memcmp(map,"YUV4MPEG2",9) == 0) indexY4M();
+            else indexRaw();
+
+            // limited range: 16 is black and 235 is white
+            for(int y=0;y<256;y++)
+                level[y] = full ? y : (uchar)min(255.0,max(0.0,round((y-16)*255.0/219)));
+        }
+
+        ~YuvFile() {
+            munmap(map,length);
+            close(fd);
+        }
+
+        // True if the path is a video that this class can read
+        static bool accepts(const string path) {
+            size_t dot = path.rfind('.');
+            string ext = dot == string::npos ? "" : path.substr(dot);
+            return ext == ".y4m" || ext == ".yuv";
+        }
+
+        int cols() const { return width; }
+        int rows() const { return height; }
+        long frames() const { return luma.size(); }
+
+        // Luma plane of the frame f (width*height bytes, row after row), as stored
+        const uchar* frame(long f) const { return map + luma[f]; }
+
+        // Gray level of each luma value (levels()[y])
+        const uchar* levels() const { return level; }
+
+        // Gray levels of the luma of the frame f inside the padded grayscale image
+        void toGray(long f,Mat* gray,int dx) const {
+            const uchar* y = frame(f);
+            for(int i=0;i<height;i++) {
+                uchar* g = gray->ptr<uchar>(i+dx)+dx;
+                const uchar* row = y+(size_t)i*width;
+                for(int j=0;j<width;j++) g[j] = level[row[j]];
+            }
+        }
+};